@@ -4,8 +4,23 @@ import abc
 class TexElement(abc.ABC):
     """
     Base class for all TeX elements
+
+    Elements can be pickled; a pickled subtree is a single compact binary blob that shares one
+    copy of the source text between all of its elements.
     """
 
+    def repr(self, max_depth=None, max_length=None):
+        """
+        ``repr`` of the element, optionally shortened for logging large trees
+
+        :param int max_depth: levels of descendants to show; deeper children are replaced by
+            ``...``
+        :param int max_length: maximum length in UTF-8 bytes before the output is cut off (never
+            inside a character) and ``...`` appended
+        :return: representation
+        :rtype: str
+        """
+
     def find_command(self, name):
         """
         Find a command matching ``name`` in descendants
@@ -43,6 +58,14 @@ class TexElement(abc.ABC):
         :rtype: list[TexEnv]
         """
 
+    def to_columns(self):
+        """
+        Export this element and all of its descendants (in document order) as columns
+
+        :return: columns
+        :rtype: TexColumns
+        """
+
     @property
     def children(self):
         """
@@ -57,8 +80,87 @@ class TexElement(abc.ABC):
         """
         Element's children
 
-        :param value: children
+        :param value: children, which must be children of this element already or have no parent
         :type value: list[TexElement]
+        :raises RuntimeError: if a child belongs to another element
+        """
+
+    @property
+    def parent(self):
+        """
+        Element containing this element
+
+        Kept up to date by the parser, by assigning ``children`` and by the editing methods below,
+        but not by modifying a ``children`` list in place.
+
+        :return: parent
+        :rtype: TexElement or None
+        """
+
+    @property
+    def structural_hash(self):
+        """
+        64-bit hash of the element's type, name and text and of its children's hashes
+
+        Equal for structurally identical subtrees regardless of their position. Kept between reads
+        and recomputed for the parts of the tree edited since, including ``children`` and ``args``
+        lists fetched to be edited in place; a list kept across reads of the hash is not followed.
+
+        :return: hash
+        :rtype: int
+        """
+
+    @property
+    def from_macro(self):
+        """
+        Whether some of the element's text was produced by expanding a macro use (see ``parse``),
+        in which case its strings and text are those of the expansion rather than of the source,
+        and its positions span the whole use
+
+        :return: whether the element came from a macro use
+        :rtype: bool
+        """
+
+    @property
+    def source_file(self):
+        """
+        Path of the file the element was parsed from, for trees built by ``parse_project``;
+        positions and lines are relative to this file, and are not recomputed after edits
+
+        :return: path
+        :rtype: str or None
+        """
+
+    def replace_with(self, element):
+        """
+        Replace this element in its parent
+
+        :param TexElement element: replacement, which must not already have a parent
+        """
+
+    def remove(self):
+        """
+        Remove this element from its parent
+        """
+
+    def insert_before(self, element):
+        """
+        Insert an element into this element's parent, just before this element
+
+        :param TexElement element: element to insert, which must not already have a parent
+        """
+
+    def insert_after(self, element):
+        """
+        Insert an element into this element's parent, just after this element
+
+        :param TexElement element: element to insert, which must not already have a parent
+        """
+
+    def unwrap(self):
+        """
+        Replace this element in its parent with its children (for commands, with the contents of
+        its arguments)
         """
 
     @property
@@ -102,6 +204,10 @@ class TexElement(abc.ABC):
         """
         Character position element starts on
 
+        Positions and lines refer to the parsed source until the tree is edited, and are then
+        recomputed from the tree's current string (but not after changing a ``children`` list
+        in place).
+
         :return: starting position
         :rtype: int
         """
@@ -159,10 +265,11 @@ class TexCommand(TexElement):
     @args.setter
     def args(self, arg):
         """
-        Command arguments (eg. ``{some text}``)
+        Command arguments (eg. ``{some text}``), which replace all of the command's children
 
-        :param arg: arguments
+        :param arg: arguments, which must be children of this command already or have no parent
         :type arg: list[TexArg]
+        :raises RuntimeError: if an element is not a ``TexArg`` or belongs to another element
         """
 
 
@@ -376,22 +483,755 @@ class TexRoot(TexElement):
         :rtype: int
         """
 
+    @property
+    def diagnostics(self):
+        """
+        Problems found while parsing, such as unclosed elements (and, in recovery mode, errors
+        that were repaired)
+
+        :return: diagnostics
+        :rtype: list[TexDiagnostic]
+        """
+
+    @property
+    def macros(self):
+        """
+        Macros defined in the document with ``\\newcommand``, ``\\def`` and similar; only
+        collected when parsing with ``expand_macros``
+
+        :return: macros by name
+        :rtype: dict[str, TexMacro]
+        """
+
+    @property
+    def xrefs(self):
+        """
+        Cross-reference index; only built when parsing with ``xrefs``
+
+        :return: index
+        :rtype: TexXrefs or None
+        """
+
+    @property
+    def outline(self):
+        """
+        Hierarchy of sectioning commands; only built when parsing with ``outline``
+
+        :return: outline
+        :rtype: TexOutline or None
+        """
+
+
+class TexOutline:
+    """
+    Sections of a document, from ``\\part`` (level 0) to ``\\subparagraph`` (level 6)
+
+    A section ends at the next sectioning command of the same or a higher level. Sectioning
+    commands inside arguments, such as in a ``\\newcommand`` body, are ignored.
+    """
+
+    @property
+    def sections(self):
+        """
+        Top-level sections
+
+        :return: sections
+        :rtype: list[TexSection]
+        """
+
+    @property
+    def all_sections(self):
+        """
+        All sections in document order, for fetching a section by number
+
+        :return: sections
+        :rtype: list[TexSection]
+        """
+
+
+class TexSection:
+    """
+    A section of the outline
+
+    Positions and lines are those found when the outline was built, while ``content`` follows
+    later edits.
+    """
+
+    @property
+    def command(self):
+        """
+        Sectioning command starting the section
+
+        :return: command
+        :rtype: TexCommand
+        """
+
+    @property
+    def level(self):
+        """
+        Depth of the sectioning command, from 0 for ``\\part`` to 6 for ``\\subparagraph``
+
+        :return: level
+        :rtype: int
+        """
+
+    @property
+    def title(self):
+        """
+        Source of the title argument
+
+        :return: title
+        :rtype: str
+        """
+
+    @property
+    def start_pos(self):
+        """
+        Position of the sectioning command
+
+        :return: position
+        :rtype: int
+        """
+
+    @property
+    def end_pos(self):
+        """
+        Position after the last element of the section (exclusive)
+
+        :return: position
+        :rtype: int
+        """
+
+    @property
+    def start_line(self):
+        """
+        Line of the sectioning command
+
+        :return: line
+        :rtype: int
+        """
+
+    @property
+    def end_line(self):
+        """
+        Line of the last element of the section
+
+        :return: line
+        :rtype: int
+        """
+
+    @property
+    def content(self):
+        """
+        Elements following the sectioning command up to the end of the section, including those
+        of subsections
+
+        :return: view of the elements
+        :rtype: TexChildrenView
+        """
+
+    @property
+    def subsections(self):
+        """
+        Sections nested in this one
+
+        :return: sections
+        :rtype: list[TexSection]
+        """
+
+
+class TexChildrenView:
+    """
+    Range of an element's children, read in place without traversing or copying the rest of the
+    tree
+
+    Supports ``len``, indexing and iteration. The range is bounded by children of ``parent``
+    (for a section, its heading and the element holding the next heading), whose indices are
+    looked up each time the view is read, so the view follows edits of the tree. Reading it
+    raises ``RuntimeError`` once one of those children has been removed from ``parent``.
+    """
+
+    @property
+    def parent(self):
+        """
+        Element whose children are viewed
+
+        :return: element
+        :rtype: TexElement
+        """
+
+    @property
+    def start(self):
+        """
+        Index of the first child in the view
+
+        :return: index
+        :rtype: int
+        """
+
+    @property
+    def end(self):
+        """
+        Index after the last child in the view (exclusive)
+
+        :return: index
+        :rtype: int
+        """
+
+    @property
+    def string(self):
+        """
+        Concatenated TeX source of the viewed children
+
+        :return: source
+        :rtype: str
+        """
+
+    def to_list(self):
+        """
+        Copy the viewed children into a list
+
+        :return: elements
+        :rtype: list[TexElement]
+        """
+
+
+class TexXrefs:
+    """
+    Labels, references and citations of a document, collected while parsing
+    """
+
+    @property
+    def labels(self):
+        """
+        ``\\label`` commands by label; a label defined more than once keeps its first
+        definition, and the others are reported in ``TexRoot.diagnostics``
+
+        :return: labels
+        :rtype: dict[str, TexXref]
+        """
+
+    @property
+    def refs(self):
+        """
+        ``\\ref``, ``\\eqref``, ``\\cref`` and similar commands by referenced label, in document
+        order; ``\\cref``-style lists of labels are split on commas
+
+        :return: references
+        :rtype: dict[str, list[TexXref]]
+        """
+
+    @property
+    def cites(self):
+        """
+        ``\\cite``, ``\\citep``, ``\\parencite`` and similar commands by citation key, in
+        document order; lists of keys are split on commas
+
+        :return: citations
+        :rtype: dict[str, list[TexXref]]
+        """
+
+
+class TexXref:
+    """
+    A label, reference or citation command and its context
+    """
+
+    @property
+    def command(self):
+        """
+        The ``\\label``, reference or citation command
+
+        :return: command
+        :rtype: TexCommand
+        """
+
+    @property
+    def env(self):
+        """
+        Innermost environment containing the command, other than ``document``
+
+        :return: environment
+        :rtype: TexEnv or None
+        """
+
+    @property
+    def section(self):
+        """
+        Sectioning command (``\\part`` to ``\\subparagraph``) whose title contains the command,
+        or else the last one before it in the same file
+
+        :return: sectioning command
+        :rtype: TexCommand or None
+        """
+
+
+class TexMacro:
+    """
+    A macro definition
+    """
+
+    @property
+    def name(self):
+        """
+        Name of the macro, without the backslash (``foo`` for ``\\foo``)
+
+        :return: name
+        :rtype: str
+        """
+
+    @property
+    def num_args(self):
+        """
+        Number of arguments the macro takes
+
+        :return: number of arguments
+        :rtype: int
+        """
+
+    @property
+    def default_arg(self):
+        """
+        Default value of the optional first argument, if the macro has one
+
+        :return: default argument
+        :rtype: str or None
+        """
+
+    @property
+    def body(self):
+        """
+        Replacement text, with ``#1`` to ``#9`` standing for the arguments
+
+        :return: body
+        :rtype: str
+        """
+
+    @property
+    def pos(self):
+        """
+        Character position of the definition
+
+        :return: position
+        :rtype: int
+        """
+
+
+class TexDiff:
+    """
+    Differences between two trees, as returned by ``diff``
+    """
+
+    @property
+    def inserted(self):
+        """
+        Elements of the new tree with no counterpart in the old tree
+
+        :return: elements
+        :rtype: list[TexElement]
+        """
+
+    @property
+    def deleted(self):
+        """
+        Elements of the old tree with no counterpart in the new tree
+
+        :return: elements
+        :rtype: list[TexElement]
+        """
+
+    @property
+    def modified(self):
+        """
+        Pairs of old and new elements of the same type and name whose own text or delimiters
+        changed
+
+        :return: pairs of elements
+        :rtype: list[tuple[TexElement, TexElement]]
+        """
+
+
+class TexDiagnostic:
+    """
+    A problem found while parsing
+    """
+
+    @property
+    def message(self):
+        """
+        Description of the problem
+
+        :return: message
+        :rtype: str
+        """
+
+    @property
+    def pos(self):
+        """
+        Character position the problem was found at
+
+        :return: position
+        :rtype: int
+        """
+
+    @property
+    def line(self):
+        """
+        Line the problem was found on
+
+        :return: line
+        :rtype: int
+        """
+
 
-def parse(string):
+class TexColumns:
+    """
+    Columnar export of a TeX tree, one row per element in document order
+
+    Each column supports the buffer protocol, so ``numpy.asarray(columns.start_pos)`` wraps it
+    without copying
+    """
+
+    def __len__(self):
+        """
+        :return: number of elements
+        :rtype: int
+        """
+
+    @property
+    def type(self):
+        """
+        Element types (``uint8``), indices into ``type_names``
+
+        :rtype: TexColumnUInt8
+        """
+
+    @property
+    def name(self):
+        """
+        Command/environment names (``int32``), indices into ``names``, or -1 for unnamed elements
+
+        :rtype: TexColumnInt32
+        """
+
+    @property
+    def start_pos(self):
+        """
+        Character positions elements start on (``uint32``)
+
+        :rtype: TexColumnUInt32
+        """
+
+    @property
+    def end_pos(self):
+        """
+        Character positions elements end on (``uint32``)
+
+        :rtype: TexColumnUInt32
+        """
+
+    @property
+    def line(self):
+        """
+        Lines elements start on (``uint16``)
+
+        :rtype: TexColumnUInt16
+        """
+
+    @property
+    def depth(self):
+        """
+        Element depths (``uint16``), 0 for the exported element
+
+        :rtype: TexColumnUInt16
+        """
+
+    @property
+    def parent(self):
+        """
+        Parent row indices (``int32``), or -1 for the exported element
+
+        :rtype: TexColumnInt32
+        """
+
+    @property
+    def names(self):
+        """
+        Dictionary of command/environment names referenced by ``name``
+
+        :rtype: list[str]
+        """
+
+    type_names = ["TexElement", "TexCommand", "TexArg", "TexEnv", "TexComment", "TexText", "TexRoot"]
+
+
+class TexPlaintext:
+    """
+    Prose extracted from TeX source by ``to_plaintext``
+    """
+
+    @property
+    def text(self):
+        """
+        Extracted text
+
+        :return: text
+        :rtype: str
+        """
+
+    @property
+    def offsets(self):
+        """
+        Source position of each character of ``text`` (``uint32``), if requested
+
+        :return: offsets
+        :rtype: TexColumnUInt32 or None
+        """
+
+
+class Parser:
+    """
+    Reusable parser that keeps its internal buffers between parses, for parsing many small
+    documents in a loop
+    """
+
+    def __init__(self, recover=False, max_retained_bytes=1048576, *, expand_macros=False,
+                 max_expansion_depth=64, max_expansion_size=67108864, xrefs=False, outline=False):
+        """
+        :param bool recover: whether to repair malformed input instead of raising (see ``parse``)
+        :param int max_retained_bytes: buffers larger than this are freed after each parse
+        :param expand_macros, max_expansion_depth, max_expansion_size, xrefs, outline: as for
+            ``parse``
+        """
+
+    def parse(self, string):
+        """
+        Parse TeX from a string
+
+        :param string: TeX string
+        :return: TeX root
+        :rtype: TexRoot
+        """
+
+    def parse_file(self, path):
+        """
+        Parse TeX from a file
+
+        :param path: path to file to parse
+        :return: TeX root
+        :rtype: TexRoot
+        """
+
+    @property
+    def max_retained_bytes(self):
+        """
+        Size above which buffers are freed after each parse
+
+        :return: bytes
+        :rtype: int
+        """
+
+
+class TexRewriteRules:
+    """
+    Rules applied by ``rewrite``
+    """
+
+    def __init__(self, rename_commands={}, rename_envs={}, delete_commands=[], delete_envs=[],
+                 replace_with_arg={}, drop_comments=False):
+        """
+        :param dict[str, str] rename_commands: new names for commands
+        :param dict[str, str] rename_envs: new names for environments
+        :param list[str] delete_commands: commands to delete, along with their arguments
+        :param list[str] delete_envs: environments to delete, along with their contents
+        :param dict[str, int] replace_with_arg: commands to replace with the contents of their
+            argument at the given (0-based) index
+        :param bool drop_comments: whether to delete comments
+        """
+
+
+def parse(string, recover=False, *, expand_macros=False, max_expansion_depth=64,
+          max_expansion_size=67108864, xrefs=False, outline=False):
     """
     Parse TeX from a string
 
+    In recovery mode, malformed input does not raise: bare groups become arguments without a
+    command, broken environments are kept as commands, an ``\\end`` for an enclosing environment
+    closes the environments opened inside it and unclosed elements are closed at the end of the
+    input, with each repair recorded in ``TexRoot.diagnostics``.
+
+    With ``expand_macros``, definitions made with ``\\newcommand``, ``\\renewcommand``,
+    ``\\providecommand``, ``\\DeclareMathOperator`` and ``\\def`` are collected into
+    ``TexRoot.macros`` and their uses are expanded before the tree is built. Elements produced
+    by an expansion have ``from_macro`` set and span the macro use they came from, while their
+    strings and text are those of the expansion.
+
     :param string: TeX string
+    :param bool recover: whether to repair malformed input instead of raising
+    :param bool expand_macros: whether to expand user-defined macros
+    :param int max_expansion_depth: maximum nesting of macro uses before raising (or, in
+        recovery mode, leaving the use unexpanded)
+    :param int max_expansion_size: maximum size in bytes of the expanded text before raising (or,
+        in recovery mode, leaving the rest of the input unexpanded)
+    :param bool xrefs: whether to build ``TexRoot.xrefs``, an index of labels, references and
+        citations
+    :param bool outline: whether to build ``TexRoot.outline``, the hierarchy of sections
     :return: TeX root
     :rtype: TexRoot
     """
 
 
-def parse_file(path):
+def parse_file(path, recover=False, *, expand_macros=False, max_expansion_depth=64,
+               max_expansion_size=67108864, xrefs=False, outline=False):
     """
     Parse TeX from a file
 
     :param path: path to file to parse
+    :param bool recover: whether to repair malformed input instead of raising (see ``parse``)
+    :param expand_macros, max_expansion_depth, max_expansion_size, xrefs, outline: as for
+        ``parse``
+    :return: TeX root
+    :rtype: TexRoot
+    """
+
+
+def parse_project(main_tex, search_paths=[], threads=0, recover=False, *, expand_macros=False,
+                  max_expansion_depth=64, max_expansion_size=67108864, xrefs=False, outline=False):
+    """
+    Parse a document split across several files into one tree
+
+    Files included with ``\\input``, ``\\include`` and ``\\subfile`` are read, scanned and
+    parsed concurrently, once each, then spliced into the tree in place of the including
+    command; only the body of the ``document`` environment of a subfile is included. Files are
+    looked up relative to the main file (subfiles first relative to the including file), then
+    in ``search_paths``, with and without a ``.tex`` extension. Every element records its file in
+    ``source_file``, and diagnostics from included files are prefixed with their path.
+    Inclusions inside command arguments, such as in a ``\\newcommand`` body, are left in place.
+
+    With ``expand_macros``, files are expanded in document order, each with the macros defined
+    before its first inclusion, and inclusions made by macro uses are followed too. With ``xrefs``, a
+    label defined in more than one file is reported in ``TexRoot.diagnostics``.
+
+    Missing files and inclusion cycles raise, or in recovery mode are recorded in
+    ``TexRoot.diagnostics`` and leave the including command in place.
+
+    :param str main_tex: path to the main file
+    :param list[str] search_paths: further directories to look for included files in
+    :param int threads: number of threads reading and parsing files, or 0 for one per CPU
+    :param bool recover: whether to repair malformed input instead of raising (see ``parse``)
+    :param expand_macros, max_expansion_depth, max_expansion_size, xrefs, outline: as for
+        ``parse``
     :return: TeX root
     :rtype: TexRoot
     """
+
+
+def diff(a, b):
+    """
+    Compare two trees, such as successive revisions of a document
+
+    Subtrees with equal ``structural_hash`` are skipped without being walked, once their top
+    elements are found to have the same type, name, delimiters and text. Children that differ are aligned by longest common
+    subsequence of their hashes, and the remaining children are paired up by type and name.
+    Changes are reported on the innermost elements that differ.
+
+    :param TexElement a: old tree
+    :param TexElement b: new tree
+    :return: differences
+    :rtype: TexDiff
+    """
+
+
+def find_duplicates(elements, min_nodes=8):
+    """
+    Find structurally identical subtrees in one or more trees, such as boilerplate repeated
+    across a corpus
+
+    Only the outermost duplicates are reported, not the subtrees they contain.
+
+    :param elements: tree or list of trees to search
+    :type elements: TexElement or list[TexElement]
+    :param int min_nodes: minimum number of elements in a reported subtree
+    :return: groups of identical subtrees, in order of first occurrence
+    :rtype: list[list[TexElement]]
+    """
+
+
+def to_plaintext(source, keep_args_of=[], drop_envs=[], offsets=False):
+    """
+    Extract the prose from TeX source without building a tree
+
+    Comments, command names and command arguments are dropped, except for the required ``{}``
+    arguments of commands in ``keep_args_of``. Environment delimiters are dropped, as are the entire contents
+    of environments in ``drop_envs``.
+
+    :param str source: TeX string
+    :param list[str] keep_args_of: names of commands whose required arguments are kept
+    :param list[str] drop_envs: names of environments whose contents are dropped
+    :param bool offsets: whether to also return the source position of each character
+    :return: extracted text
+    :rtype: TexPlaintext
+    """
+
+
+def parse_async(string, recover=False, *, expand_macros=False, max_expansion_depth=64,
+                max_expansion_size=67108864, xrefs=False, outline=False):
+    """
+    Parse TeX from a string on a native worker thread
+
+    Must be called from a running event loop. The worker parses without holding the GIL and only
+    takes it briefly to build the resulting tree, and cancelling the returned future stops the
+    parse.
+
+    :param string: TeX string
+    :param bool recover: whether to repair malformed input instead of raising (see ``parse``)
+    :param expand_macros, max_expansion_depth, max_expansion_size, xrefs, outline: as for
+        ``parse``
+    :return: future resolving to the TeX root
+    :rtype: asyncio.Future[TexRoot]
+    :raises RuntimeError: if too many documents are already queued
+    """
+
+
+def parse_file_async(path, recover=False, *, expand_macros=False, max_expansion_depth=64,
+                     max_expansion_size=67108864, xrefs=False, outline=False):
+    """
+    Parse TeX from a file on a native worker thread (see ``parse_async``)
+
+    The file is read without holding the GIL.
+
+    :param path: path to file to parse
+    :param bool recover: whether to repair malformed input instead of raising (see ``parse``)
+    :param expand_macros, max_expansion_depth, max_expansion_size, xrefs, outline: as for
+        ``parse``
+    :return: future resolving to the TeX root
+    :rtype: asyncio.Future[TexRoot]
+    :raises RuntimeError: if too many documents are already queued
+    """
+
+
+def configure_async(threads=0, max_queued=1024):
+    """
+    Configure the worker pool used by ``parse_async`` and ``parse_file_async``; must be called
+    before either is first used
+
+    :param int threads: number of worker threads, or 0 for one per CPU
+    :param int max_queued: maximum number of documents waiting for a worker
+
+    The pool is stopped when the interpreter exits, and futures for documents still waiting are
+    never resolved.
+    """
+
+
+def rewrite(source, rules, output_path=None):
+    """
+    Apply rewrite rules to TeX in a single pass, copying untouched source verbatim
+
+    :param source: TeX string, or an element whose ``outer_string`` is rewritten, which must not
+        have ``from_macro`` set
+    :type source: str or TexElement
+    :param TexRewriteRules rules: rules to apply
+    :param str output_path: file to write the result to, instead of returning it
+    :return: rewritten TeX, if ``output_path`` is not given
+    :rtype: str or None
+    """
@@ -6,6 +6,7 @@
 #include <stack>
 #include <iostream>
 #include <sstream>
+#include <iterator>
 
 #define PY_SSIZE_T_CLEAN
 
@@ -15,15 +16,48 @@
 namespace py = pybind11;
 
 #include "tex_element.h"
+#include "tex_columns.h"
+#include "tex_plaintext.h"
+#include "tex_pickle.h"
+#include "tex_rewrite.h"
+#include "tex_macros.h"
+#include "tex_diff.h"
+#include "tex_xrefs.h"
+#include "tex_outline.h"
 
 class ParseItem;
 
 class ParseText;
 
+struct ParseNode;
+
 struct EndDelimiterData;
 
+struct ParseOptions {
+	bool recover = false;
+	bool expand_macros = false;
+	size_t max_expansion_depth = 64;
+	size_t max_expansion_size = 1 << 26;
+	bool xrefs = false;
+	bool outline = false;
+};
+
+// Stack of open items, which can also be searched from the top down
+class ParseItemStack : public std::stack<std::shared_ptr<ParseItem>, std::vector<std::shared_ptr<ParseItem>>> {
+public:
+	inline const std::vector<std::shared_ptr<ParseItem>> &items() const {
+		return c;
+	}
+
+	inline std::vector<std::shared_ptr<ParseItem>> &items() {
+		return c;
+	}
+};
+
 class ParseInfo {
 public:
+	ParseOptions options;
+
 	char c;
 	std::string contents;
 
@@ -32,12 +66,31 @@ public:
 
 	std::string delimiter = "";
 
-	std::stack<std::shared_ptr<ParseItem>> curr_items;
-	std::vector<std::shared_ptr<TexElement>> parsed_elements;
+	ParseItemStack curr_items;
+	std::vector<std::shared_ptr<ParseNode>> parsed_nodes;
 
 	std::shared_ptr<ParseText> curr_text_item;
 
-	ParseInfo();
+	// whether a child was pushed into an open environment since the last check for an \end that
+	// does not match it
+	bool env_child_pushed = false;
+
+	std::vector<TexDiagnostic> diagnostics;
+
+	std::optional<TexMacroExpansion> expansion;
+
+	TexXrefCollector xrefs;
+
+	std::vector<std::shared_ptr<TexCommand>> section_commands;
+
+	// end of the parsed text, found when the parsed nodes are given their positions
+	TexPositionCursor end_cursor;
+
+	explicit ParseInfo(ParseOptions options = {});
+
+	void reset();
+
+	void trim(size_t max_retained_bytes);
 
 	void push_text_delim();
 
@@ -49,6 +102,22 @@ public:
 
 	void push_element(EndDelimiterData end_delimiter);
 
+	void close_command(EndDelimiterData end_delimiter);
+
+	bool close_mismatched_envs();
+
+	void report_error(std::string message, uint32_t pos, uint16_t line);
+
+	void close_unclosed_items();
+
+	// positions found while parsing depend on which character ended each item, so they are
+	// recomputed from the nodes' strings, as TexElement::update_positions does after edits
+	void place_nodes();
+
+	const std::string &expand_macros(const std::string &source);
+
+	std::shared_ptr<TexElement> build_element(ParseNode &node);
+
 	void _print_debug();
 
 	inline std::string get_contents_between(uint32_t start, uint32_t end) const {
@@ -56,13 +125,43 @@ public:
 	}
 
 private:
-	void _push_element(std::shared_ptr<TexElement>);
+	void _push_node(std::shared_ptr<ParseNode> node);
+};
+
+void process_char(ParseInfo &p, char c);
+
+void process_string(ParseInfo &p, const std::string &string);
+
+// closes what is still open at the end of the input, which needs no GIL
+void finish_parse(ParseInfo &p);
+
+// turns the parsed nodes into the tree, which holds the GIL
+std::shared_ptr<TexRoot> build_root(ParseInfo &p);
+
+std::shared_ptr<TexRoot> handle_file_end(ParseInfo &p);
+
+class Parser {
+public:
+	size_t max_retained_bytes;
+
+	explicit Parser(ParseOptions options = {}, size_t max_retained_bytes = 1 << 20);
+
+	std::shared_ptr<TexRoot> parse(const std::string &string);
+
+	std::shared_ptr<TexRoot> parse_file(const std::string &filename);
+
+private:
+	ParseInfo _info;
+
+	std::shared_ptr<TexRoot> _finish();
 };
 
-TexRoot parse_file(std::string filename);
+std::shared_ptr<TexRoot> parse_file(std::string filename, ParseOptions options = {});
 
-TexRoot parse(std::string string);
+std::shared_ptr<TexRoot> parse(std::string string, ParseOptions options = {});
 
 #include "parse_item.h"
+#include "parse_pool.h"
+#include "tex_project.h"
 
 #endif //FAST_TEX_PARSER_FAST_TEX_PARSER_H
@@ -14,12 +14,31 @@ struct EndDelimiterData {
 	bool handles_char = true;
 };
 
+// Element as parsed, before it is turned into a TexElement. Nodes hold no Python objects, so that
+// parsing can run without the GIL.
+struct ParseNode {
+	TexElementType type;
+	uint32_t start_pos;
+	uint16_t start_line;
+	uint32_t end_pos;
+	uint16_t end_line;
+	std::string start_delimiter;
+	std::string end_delimiter;
+	std::string contents;
+	// command or environment name
+	std::string name;
+	std::vector<std::shared_ptr<ParseNode>> children;
+
+	// last argument of a command, like TexCommand::last_arg
+	const ParseNode *last_arg() const;
+};
+
 class ParseItem {
 public:
 	uint32_t start_pos;
 	uint16_t start_line;
 	std::string start_delimiter;
-	std::vector<std::shared_ptr<TexElement>> children;
+	std::vector<std::shared_ptr<ParseNode>> children;
 	bool delim_done;
 
 	ParseItem(uint32_t pos, uint16_t line, std::string delimiter);
@@ -28,13 +47,16 @@ public:
 		throw new std::exception();
 	}
 
-	virtual std::shared_ptr<TexElement>
-	build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
-			const ParseInfo &p) {
+	virtual std::shared_ptr<ParseNode>
+	build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter, const ParseInfo &p) {
 		throw new std::exception();
 	};
 
 	virtual bool check_start_delim_done(char c);
+
+	virtual std::string describe() const {
+		return "item";
+	}
 };
 
 class ParseCommand : public ParseItem {
@@ -43,11 +65,15 @@ public:
 
 	EndDelimiterData get_end_delimiter(const ParseInfo &p) override;
 
-	std::shared_ptr<TexElement>
-	build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+	std::shared_ptr<ParseNode>
+	build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 			const ParseInfo &p) override;
 
 	bool check_start_delim_done(char c) override;
+
+	inline std::string describe() const override {
+		return "command " + start_delimiter;
+	}
 };
 
 class ParseArg : public ParseItem {
@@ -56,22 +82,33 @@ public:
 
 	EndDelimiterData get_end_delimiter(const ParseInfo &p) override;
 
-	std::shared_ptr<TexElement>
-	build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+	std::shared_ptr<ParseNode>
+	build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 			const ParseInfo &p) override;
+
+	inline std::string describe() const override {
+		return "argument " + start_delimiter;
+	}
 };
 
 class ParseEnv : public ParseItem {
 public:
 	std::string name;
 
-	ParseEnv(uint32_t pos, uint16_t line, std::shared_ptr<TexCommand> start_command);
+	ParseEnv(uint32_t pos, uint16_t line, const ParseNode &start_command);
+
+	// name of the environment an \end command ends, if the node is one
+	static std::optional<std::string> get_ended_name(const ParseNode &node);
 
 	EndDelimiterData get_end_delimiter(const ParseInfo &p) override;
 
-	std::shared_ptr<TexElement>
-	build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+	std::shared_ptr<ParseNode>
+	build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 			const ParseInfo &p) override;
+
+	inline std::string describe() const override {
+		return "environment " + name;
+	}
 };
 
 class ParseComment : public ParseItem {
@@ -82,9 +119,13 @@ public:
 
 	EndDelimiterData get_end_delimiter(const ParseInfo &p) override;
 
-	std::shared_ptr<TexElement>
-	build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+	std::shared_ptr<ParseNode>
+	build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 			const ParseInfo &p) override;
+
+	inline std::string describe() const override {
+		return "comment";
+	}
 };
 
 class ParseText : public ParseItem {
@@ -95,8 +136,8 @@ public:
 
 	EndDelimiterData get_end_delimiter(const ParseInfo &p) override;
 
-	std::shared_ptr<TexElement>
-	build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+	std::shared_ptr<ParseNode>
+	build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 			const ParseInfo &p) override;
 };
 
@@ -0,0 +1,61 @@
+#ifndef FAST_TEX_PARSER_PARSE_POOL_H
+#define FAST_TEX_PARSER_PARSE_POOL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <iterator>
+
+#include "fast_tex_parser.h"
+
+// characters parsed between checks for cancellation
+static const size_t PARSE_POOL_CHUNK_SIZE = 1 << 16;
+static const size_t PARSE_POOL_MAX_RETAINED_BYTES = 1 << 20;
+
+struct ParseJob {
+	std::string source;
+	bool is_file;
+	ParseOptions options;
+	py::object loop;
+	py::object future;
+	std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+// Parses on native worker threads and resolves asyncio futures with the results
+class ParsePool {
+public:
+	ParsePool(size_t threads, size_t max_queued);
+
+	~ParsePool();
+
+	py::object submit(std::string source, bool is_file, ParseOptions options);
+
+	static ParsePool &get_default();
+
+	static void configure_default(size_t threads, size_t max_queued);
+
+	static void shutdown_default();
+
+private:
+	std::vector<std::thread> _threads;
+	std::deque<ParseJob> _queue;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	size_t _max_queued;
+	bool _stopping = false;
+
+	void _work();
+
+	void _run(ParseJob &job, ParseInfo &p);
+
+	void _parse(ParseJob &job, ParseInfo &p);
+
+	static void _resolve(ParseJob &job, py::object result, py::object exception);
+};
+
+#endif //FAST_TEX_PARSER_PARSE_POOL_H
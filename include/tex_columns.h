@@ -0,0 +1,57 @@
+#ifndef FAST_TEX_PARSER_TEX_COLUMNS_H
+#define FAST_TEX_PARSER_TEX_COLUMNS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include "tex_element.h"
+
+extern const std::vector<std::string> TEX_ELEMENT_TYPE_NAMES;
+
+template<typename T>
+class TexColumn {
+public:
+	std::vector<T> values;
+
+	inline size_t size() const {
+		return values.size();
+	}
+
+	inline py::buffer_info buffer() {
+		return py::buffer_info(values.data(), sizeof(T), py::format_descriptor<T>::format(), 1,
+				{values.size()}, {sizeof(T)});
+	}
+};
+
+class TexColumns {
+public:
+	std::shared_ptr<TexColumn<uint8_t>> type;
+	std::shared_ptr<TexColumn<int32_t>> name;
+	std::shared_ptr<TexColumn<uint32_t>> start_pos;
+	std::shared_ptr<TexColumn<uint32_t>> end_pos;
+	std::shared_ptr<TexColumn<uint16_t>> line;
+	std::shared_ptr<TexColumn<uint16_t>> depth;
+	std::shared_ptr<TexColumn<int32_t>> parent;
+	std::vector<std::string> names;
+
+	explicit TexColumns(TexElement &element);
+
+	inline size_t size() const {
+		return type->size();
+	}
+
+private:
+	std::unordered_map<std::string, int32_t> _name_indices;
+
+	int32_t _intern_name(const std::string &name);
+
+	void _add_element(TexElement &element, uint16_t depth, int32_t parent);
+};
+
+#endif //FAST_TEX_PARSER_TEX_COLUMNS_H
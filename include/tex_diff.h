@@ -0,0 +1,57 @@
+#ifndef FAST_TEX_PARSER_TEX_DIFF_H
+#define FAST_TEX_PARSER_TEX_DIFF_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include "tex_element.h"
+
+// largest children lists (product of both sizes) aligned by longest common subsequence; larger
+// ones are aligned greedily
+static const size_t TEX_DIFF_MAX_LCS_CELLS = 1 << 22;
+
+struct TexDiff {
+	std::vector<std::shared_ptr<TexElement>> inserted;
+	std::vector<std::shared_ptr<TexElement>> deleted;
+	std::vector<std::pair<std::shared_ptr<TexElement>, std::shared_ptr<TexElement>>> modified;
+
+	std::string __repr__() const;
+};
+
+// Compares two trees by structural hash, descending only into subtrees that differ. Subtrees with
+// equal hashes are skipped once their top elements are found to match.
+class TexDiffer {
+public:
+	TexDiff diff(const std::shared_ptr<TexElement> &a, const std::shared_ptr<TexElement> &b);
+
+private:
+	TexDiff _result;
+
+	void _diff_elements(const std::shared_ptr<TexElement> &a, const std::shared_ptr<TexElement> &b);
+
+	void _diff_children(const TexElement &a, const TexElement &b);
+
+	void _align(const std::vector<std::shared_ptr<TexElement>> &a, size_t a_start, size_t a_end,
+			const std::vector<std::shared_ptr<TexElement>> &b, size_t b_start, size_t b_end);
+
+	static bool _matches(const TexElement &a, const TexElement &b);
+};
+
+// whether two subtrees are identical, by hash and by their top elements; their hashes must be up to
+// date
+bool equal_subtrees(const TexElement &a, const TexElement &b);
+
+TexDiff diff(const std::shared_ptr<TexElement> &a, const std::shared_ptr<TexElement> &b);
+
+// groups of structurally identical subtrees of at least min_nodes nodes, outermost ones only
+std::vector<std::vector<std::shared_ptr<TexElement>>>
+find_duplicates(const std::vector<std::shared_ptr<TexElement>> &elements, uint32_t min_nodes);
+
+#endif //FAST_TEX_PARSER_TEX_DIFF_H
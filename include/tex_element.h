@@ -2,24 +2,158 @@
 #define FAST_TEX_PARSER_TEX_ELEMENT_H
 
 #include <string>
+#include <string_view>
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <memory>
-#include <regex>
 #include <optional>
 #include <map>
 #include <cassert>
 #include <functional>
+#include <algorithm>
 #include <iostream>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
 namespace py = pybind11;
 
+static const uint64_t TEX_HASH_SEED = 0xcbf29ce484222325ULL;
+
+// FNV-1a, so that hashes are stable across platforms and runs
+inline uint64_t hash_bytes(std::string_view bytes, uint64_t hash = TEX_HASH_SEED) {
+	for (char c: bytes) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+inline uint64_t hash_combine(uint64_t hash, uint64_t value) {
+	return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+
+// frees the storage of an emptied buffer that is reused across parses, if it has grown too large
+template<typename T>
+inline void trim_buffer(std::vector<T> &buffer, size_t max_retained_bytes) {
+	if (buffer.capacity() * sizeof(T) > max_retained_bytes)
+		std::vector<T>().swap(buffer);
+}
+
+// escape sequences used in reprs, by character
+extern const std::array<const char *, 256> TEX_REPR_ESCAPES;
+
+inline void append_escaped(std::string &out, std::string_view text) {
+	size_t start = 0;
+	for (size_t i = 0; i < text.size(); i++) {
+		const char *escape = TEX_REPR_ESCAPES[static_cast<uint8_t>(text[i])];
+		if (escape != nullptr) {
+			out.append(text, start, i - start);
+			out += escape;
+			start = i + 1;
+		}
+	}
+	out.append(text, start, text.size() - start);
+}
+
+// Streams the repr of a tree into one buffer, optionally cut off below a depth or after a length
+class TexReprWriter {
+public:
+	std::string out;
+	size_t max_depth;
+	size_t max_length;
+	size_t depth = 0;
+	bool truncated = false;
+
+	explicit TexReprWriter(size_t max_depth = SIZE_MAX, size_t max_length = SIZE_MAX)
+			: max_depth(max_depth), max_length(max_length) {
+	}
+
+	inline void write(std::string_view text) {
+		if (truncated)
+			return;
+		out += text;
+		_check_length();
+	}
+
+	inline void write_escaped(std::string_view text) {
+		if (truncated)
+			return;
+		append_escaped(out, text);
+		_check_length();
+	}
+
+	inline void write_indent(uint8_t indent_level) {
+		if (truncated || indent_level <= 0)
+			return;
+		out.append(indent_level * 4, ' ');
+		_check_length();
+	}
+
+	inline std::string finish() {
+		if (truncated)
+			out += "...";
+		return std::move(out);
+	}
+
+private:
+	inline void _check_length() {
+		if (out.size() > max_length) {
+			// cut before a character whose UTF-8 sequence would be split, rather than through it
+			size_t length = max_length;
+			while (length > 0 && (static_cast<uint8_t>(out[length]) & 0xC0) == 0x80)
+				length--;
+			out.resize(length);
+			truncated = true;
+		}
+	}
+};
+
 class TexCommand;
 
 class TexEnv;
 
-class TexElement {
+class TexColumns;
+
+class TexTreeEncoder;
+
+class TexTreeDecoder;
+
+class TexProjectLoader;
+
+class TexXrefs;
+
+class TexOutline;
+
+// Walks a tree's string to give its elements their positions, both when parsing ends and after edits
+struct TexPositionCursor {
+	uint32_t pos = 0;
+	uint16_t line = 0;
+	bool after_newline = false;
+
+	inline void advance(std::string_view text) {
+		if (text.empty())
+			return;
+		pos += text.size();
+		line += std::count(text.begin(), text.end(), '\n');
+		after_newline = text.back() == '\n';
+	}
+
+	// ends an element (or parse node) that started at its start_pos: text ends after its last
+	// character and other elements on it
+	template<typename T>
+	inline void end(T &element, bool is_text) const {
+		if (is_text || pos == element.start_pos) {
+			element.end_pos = pos;
+			element.end_line = line;
+		} else {
+			element.end_pos = pos - 1;
+			element.end_line = line - after_newline;
+		}
+	}
+};
+
+class TexElement : public std::enable_shared_from_this<TexElement> {
 public:
 	uint32_t start_pos;
 	uint16_t start_line;
@@ -30,6 +164,23 @@ public:
 	py::list children;
 	std::optional<std::string> _string;
 	std::optional<std::string> _inner_string;
+	std::weak_ptr<TexElement> parent;
+	// where the element was last seen among its parent's children, which edits do not keep up to date
+	uint32_t _index_in_parent = 0;
+	// set on the top element of a tree when the tree is edited, so that positions are recomputed
+	// from its string when they are next read
+	bool _positions_stale = false;
+	// file the element was parsed from, shared by all elements of the file
+	std::shared_ptr<const std::string> source_file;
+	// whether some of the element's text was produced by a macro use, in which case its strings
+	// and text are those of the expansion and its positions span the use
+	bool from_macro = false;
+	// hash of the element's type, name and delimiters (or text) and of its children's hashes, as of
+	// the last update_hash
+	uint64_t _hash = 0;
+	// set on the element and its ancestors when the element is edited, or when its children or
+	// arguments are handed out to be edited in place, so that the hash is recomputed when next read
+	bool _hash_stale = true;
 
 	TexElement(uint32_t start_pos, uint16_t start_line, uint32_t end_pos, uint16_t end_line,
 			std::string start_delimiter, std::string end_delimiter, std::string contents,
@@ -39,11 +190,19 @@ public:
 
 	std::string __repr__();
 
-	virtual std::string repr(uint8_t indent_level = 0);
+	std::string repr(uint8_t indent_level = 0);
 
-	virtual std::string string();
+	std::string repr_truncated(std::optional<size_t> max_depth, std::optional<size_t> max_length);
 
-	virtual std::string inner_string();
+	virtual void write_repr(TexReprWriter &writer, uint8_t indent_level = 0);
+
+	std::string string();
+
+	std::string inner_string();
+
+	virtual void write_string(std::string &out);
+
+	virtual void write_inner_string(std::string &out);
 
 	std::optional<std::shared_ptr<TexCommand>> find_command(std::string name);
 
@@ -55,6 +214,73 @@ public:
 
 	std::vector<std::shared_ptr<TexEnv>> find_envs(std::string name);
 
+	std::shared_ptr<TexColumns> to_columns();
+
+	inline std::shared_ptr<TexElement> get_parent() const {
+		return parent.lock();
+	}
+
+	void set_children(py::list children);
+
+	// makes this element the parent of its children, which must not have another parent
+	void adopt_children();
+
+	// recomputes the positions of the element's tree if it was edited since they were last read
+	void update_positions();
+
+	inline uint32_t get_start_pos() {
+		update_positions();
+		return start_pos;
+	}
+
+	inline uint16_t get_start_line() {
+		update_positions();
+		return start_line;
+	}
+
+	inline uint32_t get_end_pos() {
+		update_positions();
+		return end_pos;
+	}
+
+	inline uint16_t get_end_line() {
+		update_positions();
+		return end_line;
+	}
+
+	inline uint64_t get_structural_hash() {
+		return update_hash();
+	}
+
+	uint64_t label_hash() const;
+
+	// recomputes the hashes of the element and of its descendants that are stale
+	uint64_t update_hash();
+
+	void _invalidate_hash();
+
+	inline std::string get_start_delimiter() const {
+		return start_delimiter;
+	}
+
+	void set_start_delimiter(std::string start_delimiter);
+
+	inline std::string get_end_delimiter() const {
+		return end_delimiter;
+	}
+
+	void set_end_delimiter(std::string end_delimiter);
+
+	void replace_with(std::shared_ptr<TexElement> element);
+
+	void remove();
+
+	void insert_before(std::shared_ptr<TexElement> element);
+
+	void insert_after(std::shared_ptr<TexElement> element);
+
+	void unwrap();
+
 	inline std::shared_ptr<TexElement> last_child() {
 		if (children.empty())
 			throw std::runtime_error("tried to access last child of empty element");
@@ -62,13 +288,16 @@ public:
 	}
 
 protected:
-	std::string get_children_repr(uint8_t indent_level = 0);
+	friend class TexProjectLoader;
 
-	std::string get_children_string();
+	friend class TexChildrenView;
 
-	std::string _default_repr(std::string type_name, uint8_t indent_level = 0,
-			std::optional<std::string> _start_delimiter = {},
-			std::optional<std::string> _end_delimiter = {});
+	void _write_children_repr(TexReprWriter &writer, uint8_t indent_level);
+
+	void _write_children_string(std::string &out);
+
+	void _write_default_repr(TexReprWriter &writer, std::string_view type_name, uint8_t indent_level,
+			std::string_view start_delimiter, std::string_view end_delimiter);
 
 	template<typename T>
 	std::optional<std::shared_ptr<T>> _find_element(std::function<bool(std::shared_ptr<T>)> test);
@@ -76,11 +305,20 @@ protected:
 	template<typename T>
 	std::vector<std::shared_ptr<T>> _find_elements(std::function<bool(std::shared_ptr<T>)> test);
 
-	inline std::string _get_indent(uint8_t indent_level) {
-		if (indent_level <= 0)
-			return "";
-		return std::string(indent_level * 4, ' ');
-	}
+	std::pair<std::shared_ptr<TexElement>, size_t> _locate();
+
+	size_t _find_child(const TexElement *child, size_t hint) const;
+
+	void _check_insertable(const std::shared_ptr<TexElement> &element) const;
+
+	// replaces children [start, end) with elements; unless positions is false, the tree's positions
+	// are recomputed when next read
+	void _splice_children(size_t start, size_t end,
+			const std::vector<std::shared_ptr<TexElement>> &elements, bool positions = true);
+
+	void _place(TexPositionCursor &cursor);
+
+	void _invalidate(bool positions = true);
 };
 
 class TexArg : public TexElement {
@@ -92,7 +330,7 @@ public:
 	TexArg(std::string start_delimiter = "{", std::string end_delimiter = "}",
 			py::list children = py::list());
 
-	std::string repr(uint8_t indent_level = 0) override;
+	void write_repr(TexReprWriter &writer, uint8_t indent_level = 0) override;
 };
 
 class TexCommand : public TexElement {
@@ -106,9 +344,17 @@ public:
 
 	TexCommand(std::string name, py::list args = py::list());
 
-	std::string repr(uint8_t indent_level = 0) override;
+	// the list can be edited in place, so the hash is recomputed when next read
+	inline py::list get_args() {
+		_invalidate_hash();
+		return args;
+	}
+
+	void set_args(py::list args);
+
+	void write_repr(TexReprWriter &writer, uint8_t indent_level = 0) override;
 
-	std::string inner_string() override;
+	void write_inner_string(std::string &out) override;
 
 	inline std::string get_name() {
 		return name;
@@ -122,12 +368,26 @@ public:
 		return py::cast<std::shared_ptr<TexArg>>(args[args.size() - 1]);
 	}
 
+	// last argument in braces, skipping trailing optional ones
+	std::shared_ptr<TexArg> last_mandatory_arg();
+
+	// text of the last argument in braces, or an empty string if there is none
+	std::string last_mandatory_arg_text();
+
 private:
+	friend class TexElement;
+
+	friend class TexTreeEncoder;
+
+	friend class TexTreeDecoder;
+
 	std::string _args_string;
 
 	bool _args_has_changes();
 
 	bool _update_children();
+
+	void _rebuild_args();
 };
 
 class TexEnv : public TexElement {
@@ -140,7 +400,7 @@ public:
 
 	TexEnv(std::string name, py::list children = py::list());
 
-	std::string repr(uint8_t indent_level = 0) override;
+	void write_repr(TexReprWriter &writer, uint8_t indent_level = 0) override;
 
 	inline std::string get_name() {
 		return name;
@@ -158,9 +418,15 @@ public:
 
 	TexComment(std::string text);
 
-	std::string repr(uint8_t indent_level = 0) override;
+	inline std::string get_text() const {
+		return text;
+	}
+
+	void set_text(std::string text);
 
-	std::string inner_string() override;
+	void write_repr(TexReprWriter &writer, uint8_t indent_level = 0) override;
+
+	void write_inner_string(std::string &out) override;
 };
 
 class TexText : public TexElement {
@@ -172,23 +438,75 @@ public:
 
 	TexText(std::string text);
 
-	std::string repr(uint8_t indent_level = 0) override;
+	inline std::string get_text() const {
+		return text;
+	}
+
+	void set_text(std::string text);
 
+	void write_repr(TexReprWriter &writer, uint8_t indent_level = 0) override;
 
-	std::string inner_string() override;
+
+	void write_inner_string(std::string &out) override;
+};
+
+struct TexDiagnostic {
+	std::string message;
+	uint32_t pos;
+	uint16_t line;
+
+	std::string __repr__() const;
+};
+
+struct TexMacro {
+	std::string name;
+	uint8_t num_args;
+	std::optional<std::string> default_arg;
+	std::string body;
+	uint32_t pos;
+
+	std::string __repr__() const;
 };
 
 class TexRoot : public TexElement {
 public:
 	uint32_t length;
 	uint16_t lines;
+	std::vector<TexDiagnostic> diagnostics;
+	std::map<std::string, TexMacro> macros;
+	std::shared_ptr<TexXrefs> xrefs;
+	std::shared_ptr<TexOutline> outline;
 
 	TexRoot(uint32_t length, uint16_t lines, std::string contents,
 			std::vector<std::shared_ptr<TexElement>> children);
 
 	TexRoot(py::list children = py::list());
 
-	std::string repr(uint8_t indent_level = 0) override;
+	void write_repr(TexReprWriter &writer, uint8_t indent_level = 0) override;
+};
+
+// sectioning commands by depth, from \part to \subparagraph
+extern const std::map<std::string, uint8_t, std::less<>> TEX_SECTION_LEVELS;
+
+enum class TexElementType : uint8_t {
+	ELEMENT, COMMAND, ARG, ENV, COMMENT, TEXT, ROOT
 };
 
+inline TexElementType get_element_type(const TexElement &element) {
+	const std::type_info &type = typeid(element);
+	if (type == typeid(TexCommand))
+		return TexElementType::COMMAND;
+	if (type == typeid(TexText))
+		return TexElementType::TEXT;
+	if (type == typeid(TexArg))
+		return TexElementType::ARG;
+	if (type == typeid(TexEnv))
+		return TexElementType::ENV;
+	if (type == typeid(TexComment))
+		return TexElementType::COMMENT;
+	if (type == typeid(TexRoot))
+		return TexElementType::ROOT;
+	return TexElementType::ELEMENT;
+}
+
 #endif //FAST_TEX_PARSER_TEX_ELEMENT_H
@@ -0,0 +1,95 @@
+#ifndef FAST_TEX_PARSER_TEX_MACROS_H
+#define FAST_TEX_PARSER_TEX_MACROS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+
+#include "tex_element.h"
+#include "tex_scanner.h"
+
+// Text produced by a macro use in the source, as a range of the expanded text
+struct TexMacroUse {
+	uint32_t start;
+	uint32_t end;
+	// end of the use (including its arguments) in the source
+	uint32_t source_end;
+};
+
+// Source expanded by MacroExpander, with the original position of every expanded character
+class TexMacroExpansion {
+public:
+	std::string text;
+	std::vector<uint32_t> offsets;
+	std::vector<TexMacroUse> uses;
+	std::map<std::string, TexMacro, std::less<>> macros;
+	std::vector<TexDiagnostic> diagnostics;
+	std::vector<uint32_t> line_starts;
+	uint32_t source_size = 0;
+
+	inline uint32_t map_pos(uint32_t pos) const {
+		if (pos < offsets.size())
+			return offsets[pos];
+		return source_size + (pos - offsets.size());
+	}
+
+	// maps an inclusive end position, which is moved to the end of the macro use it falls in
+	uint32_t map_end_pos(uint32_t pos) const;
+
+	uint16_t get_line(uint32_t pos) const;
+
+	// moves positions of a tree parsed from the expanded text back to the original source
+	void apply(TexRoot &root) const;
+
+private:
+	const TexMacroUse *_find_use(uint32_t pos) const;
+
+	bool _overlaps_use(uint32_t start, uint32_t end) const;
+
+	void _remap(TexElement &element) const;
+};
+
+// Records \newcommand, \renewcommand, \providecommand, \def and \DeclareMathOperator
+// definitions and expands later uses of the defined macros
+class MacroExpander {
+public:
+	// macros can be given that were defined before the source, such as in a file including it
+	MacroExpander(std::string_view source, size_t max_depth, size_t max_size, bool recover,
+			std::map<std::string, TexMacro, std::less<>> macros = {});
+
+	TexMacroExpansion expand();
+
+	// called, if set, for each \input, \include or \subfile outside groups, with the macro table to
+	// update with the definitions made by the included file
+	std::function<void(std::string_view command, std::string_view target,
+			std::map<std::string, TexMacro, std::less<>> &macros)> on_include;
+
+private:
+	std::string_view source;
+	size_t max_depth;
+	size_t max_size;
+	bool recover;
+	TexMacroExpansion _expansion;
+	// expansions keyed by macro, arguments and depth, as deeper uses have less depth left to expand in
+	std::unordered_map<std::string, std::string> _memo;
+	// groups open in the source, including those of the macro bodies being expanded
+	size_t _group_depth = 0;
+
+	void _expand(std::string_view text, size_t depth, std::optional<uint32_t> use_pos, std::string &out,
+			std::vector<uint32_t> *offsets);
+
+	size_t _read_definition(const TexScanner &scanner, size_t i, std::string_view command,
+			size_t name_end, uint32_t pos);
+
+	bool _read_use_args(const TexScanner &scanner, const TexMacro &macro, size_t &i,
+			std::vector<std::string> &args) const;
+
+	std::string _expand_use(const TexMacro &macro, const std::vector<std::string> &args, size_t depth,
+			uint32_t pos);
+};
+
+#endif //FAST_TEX_PARSER_TEX_MACROS_H
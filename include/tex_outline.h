@@ -0,0 +1,74 @@
+#ifndef FAST_TEX_PARSER_TEX_OUTLINE_H
+#define FAST_TEX_PARSER_TEX_OUTLINE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include "tex_element.h"
+
+// Range of an element's children, read in place without copying them. The range is bounded by
+// children rather than indices, which are looked up when the view is read so that it follows edits.
+class TexChildrenView {
+public:
+	std::shared_ptr<TexElement> element;
+	// child the range starts after, or none to start at the first child
+	std::shared_ptr<TexElement> after;
+	// child the range ends before, or none to end at the last child
+	std::shared_ptr<TexElement> before;
+
+	size_t start() const;
+
+	size_t end() const;
+
+	inline size_t size() const {
+		size_t start = this->start();
+		size_t end = this->end();
+		return end > start ? end - start : 0;
+	}
+
+	std::shared_ptr<TexElement> get(int64_t index) const;
+
+	py::list to_list() const;
+
+	std::string string() const;
+
+	std::string __repr__() const;
+
+private:
+	size_t _find_bound(TexElement &child) const;
+};
+
+class TexSection {
+public:
+	std::shared_ptr<TexCommand> command;
+	uint8_t level;
+	std::string title;
+	uint32_t start_pos;
+	uint16_t start_line;
+	uint32_t end_pos;
+	uint16_t end_line;
+	// elements after the heading, up to the next heading of the same or a higher level
+	TexChildrenView content;
+	std::vector<std::shared_ptr<TexSection>> subsections;
+
+	std::string __repr__() const;
+};
+
+class TexOutline {
+public:
+	std::vector<std::shared_ptr<TexSection>> sections;
+	std::vector<std::shared_ptr<TexSection>> all_sections;
+};
+
+// builds the outline from the tree's sectioning commands, in document order
+std::shared_ptr<TexOutline> build_outline(const std::vector<std::shared_ptr<TexCommand>> &commands);
+
+void find_section_commands(TexElement &element, std::vector<std::shared_ptr<TexCommand>> &commands);
+
+#endif //FAST_TEX_PARSER_TEX_OUTLINE_H
@@ -0,0 +1,117 @@
+#ifndef FAST_TEX_PARSER_TEX_PICKLE_H
+#define FAST_TEX_PARSER_TEX_PICKLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <unordered_map>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include "tex_element.h"
+#include "tex_xrefs.h"
+#include "tex_outline.h"
+
+static const uint32_t TEX_PICKLE_MAGIC = 0x31505446; // "FTP1"
+static const uint32_t TEX_PICKLE_NO_INDEX = 0xFFFFFFFF;
+
+// how a node's cached _string/_inner_string is stored
+enum class TexCachedString : uint8_t {
+	NONE, SOURCE, TEXT, TABLE, DERIVED
+};
+
+// Encodes a tree as a string table, one shared source blob and fixed-size node records
+class TexTreeEncoder {
+public:
+	std::string encode(TexElement &element);
+
+private:
+	std::string _nodes;
+	std::vector<const std::string *> _strings;
+	std::unordered_map<std::string_view, uint32_t> _string_indices;
+	std::string_view _source;
+	uint32_t _source_start;
+	// pre-order index of each node, recorded for trees with nodes referenced from the root
+	bool _index_nodes = false;
+	std::unordered_map<const TexElement *, uint32_t> _node_indices;
+
+	template<typename T>
+	inline void _write(std::string &out, T value) {
+		out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+
+	// the table keeps a pointer to the string, which must live until encode() returns
+	uint32_t _intern(const std::string &string);
+
+	void _write_cached_string(const std::optional<std::string> &cached, const TexElement &element,
+			const std::string *text, bool inner);
+
+	void _write_element(TexElement &element);
+
+	void _write_node_index(const std::shared_ptr<TexElement> &element);
+
+	void _write_xref(const TexXref &xref);
+
+	void _write_xrefs(const TexXrefs &xrefs);
+};
+
+class TexTreeDecoder {
+public:
+	explicit TexTreeDecoder(std::string_view data) : _data(data) {
+	}
+
+	std::shared_ptr<TexElement> decode();
+
+private:
+	std::string_view _data;
+	size_t _pos = 0;
+	std::vector<std::string_view> _strings;
+	std::string_view _source;
+	std::unordered_map<uint32_t, std::shared_ptr<const std::string>> _source_files;
+	std::vector<std::shared_ptr<TexElement>> _elements;
+
+	template<typename T>
+	inline T _read() {
+		T value;
+		std::memcpy(&value, _read_bytes(sizeof(T)).data(), sizeof(T));
+		return value;
+	}
+
+	std::string_view _read_bytes(size_t size);
+
+	std::string _read_string();
+
+	std::shared_ptr<const std::string> _read_source_file(uint32_t index);
+
+	std::optional<std::string> _read_cached_string(const TexElement &element, const std::string *text,
+			const std::optional<std::string> &outer);
+
+	std::shared_ptr<TexElement> _read_element();
+
+	template<typename T>
+	std::shared_ptr<T> _read_node() {
+		uint32_t index = _read<uint32_t>();
+		if (index == TEX_PICKLE_NO_INDEX)
+			return nullptr;
+		if (index >= _elements.size())
+			throw std::runtime_error("corrupt pickled TeX element");
+		std::shared_ptr<T> element = std::dynamic_pointer_cast<T>(_elements[index]);
+		if (!element)
+			throw std::runtime_error("corrupt pickled TeX element");
+		return element;
+	}
+
+	std::optional<TexXref> _read_xref();
+
+	std::shared_ptr<TexXrefs> _read_xrefs();
+};
+
+std::string encode_tree(TexElement &element);
+
+std::shared_ptr<TexElement> decode_tree(std::string_view data);
+
+#endif //FAST_TEX_PARSER_TEX_PICKLE_H
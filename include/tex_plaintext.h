@@ -0,0 +1,51 @@
+#ifndef FAST_TEX_PARSER_TEX_PLAINTEXT_H
+#define FAST_TEX_PARSER_TEX_PLAINTEXT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+
+#include "tex_scanner.h"
+#include "tex_columns.h"
+
+class TexPlaintext {
+public:
+	std::string text;
+	std::optional<std::shared_ptr<TexColumn<uint32_t>>> offsets;
+};
+
+// Extracts prose from TeX source in a single pass, dropping comments, command names, optional
+// arguments and the arguments of commands not listed in keep_args_of
+class PlaintextExtractor {
+public:
+	std::string text;
+	std::vector<uint32_t> offsets;
+
+	PlaintextExtractor(std::string_view source, const std::vector<std::string> &keep_args_of,
+			const std::vector<std::string> &drop_envs, bool with_offsets);
+
+	void extract();
+
+private:
+	TexScanner scanner;
+	std::unordered_set<std::string_view> keep_args_of;
+	std::unordered_set<std::string_view> drop_envs;
+	bool with_offsets;
+
+	inline void _emit(char c, size_t pos) {
+		text += c;
+		if (with_offsets)
+			offsets.push_back(pos);
+	}
+
+	void _extract_range(size_t start, size_t end);
+
+	size_t _extract_command(size_t i, size_t end);
+};
+
+std::shared_ptr<TexPlaintext>
+to_plaintext(const std::string &source, const std::vector<std::string> &keep_args_of,
+		const std::vector<std::string> &drop_envs, bool offsets);
+
+#endif //FAST_TEX_PARSER_TEX_PLAINTEXT_H
@@ -0,0 +1,109 @@
+#ifndef FAST_TEX_PARSER_TEX_PROJECT_H
+#define FAST_TEX_PARSER_TEX_PROJECT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+#include "fast_tex_parser.h"
+
+extern const std::set<std::string, std::less<>> TEX_PROJECT_INCLUDE_COMMANDS;
+
+struct TexProjectFile {
+	std::string path;
+	// contents of the file, read ahead by the loader threads and dropped once the file is parsed
+	std::string source;
+	bool loaded = false;
+	std::optional<std::string> error;
+	// inclusion targets found in the file, mapped to the key of the included file if it exists
+	std::unordered_map<std::string, std::optional<std::string>> targets;
+	size_t uses = 0;
+	// expansion with the macros defined before the file's first inclusion, in document order
+	std::optional<TexMacroExpansion> expansion;
+	// the file parsed by the loader threads, and turned into a tree when it is first included
+	std::unique_ptr<ParseInfo> parsed;
+	std::optional<std::string> parse_error;
+	// pickled tree, kept for files included more than once
+	std::string encoded;
+	bool merged = false;
+};
+
+// Loads a document split across several files and splices the included files into one tree
+class TexProjectLoader {
+public:
+	TexProjectLoader(const std::string &main_tex, const std::vector<std::string> &search_paths,
+			ParseOptions options, size_t threads);
+
+	std::shared_ptr<TexRoot> load();
+
+private:
+	ParseOptions _options;
+	// options the files are parsed with, on their own
+	ParseOptions _file_options;
+	size_t _threads;
+	std::filesystem::path _main_dir;
+	std::vector<std::filesystem::path> _search_paths;
+	std::string _main_key;
+	std::map<std::string, TexProjectFile> _files;
+
+	std::deque<TexProjectFile *> _queue;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	size_t _active = 0;
+
+	std::shared_ptr<TexRoot> _root;
+	std::vector<const TexProjectFile *> _stack;
+	// files being expanded, outermost first
+	std::vector<const TexProjectFile *> _expanding;
+	// macros defined so far, in document order
+	std::map<std::string, TexMacro, std::less<>> _macros;
+
+	void _run_threads(void (TexProjectLoader::*work)());
+
+	void _work();
+
+	void _work_parse();
+
+	bool _read(TexProjectFile &file);
+
+	std::vector<std::pair<std::string, std::string>> _scan(TexProjectFile &file);
+
+	std::optional<std::filesystem::path> _resolve(const std::string &target, const TexProjectFile &file,
+			bool relative_to_file) const;
+
+	// the included file for an inclusion target, resolving targets the scanner did not see
+	TexProjectFile *_find_included(TexProjectFile &file, std::string_view command, const std::string &target);
+
+	void _expand_macros(TexProjectFile &file);
+
+	void _parse(TexProjectFile &file);
+
+	std::shared_ptr<TexRoot> _build(TexProjectFile &file);
+
+	void _expand_includes(TexElement &element, TexProjectFile &file);
+
+	std::optional<std::vector<std::shared_ptr<TexElement>>> _include(TexCommand &command,
+			TexProjectFile &file);
+
+	void _report_error(std::string message, uint32_t pos, uint16_t line);
+
+	inline static std::string _get_key(const std::filesystem::path &path) {
+		std::error_code error;
+		std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+		return error ? path.lexically_normal().string() : canonical.string();
+	}
+};
+
+std::shared_ptr<TexRoot> parse_project(const std::string &main_tex,
+		const std::vector<std::string> &search_paths = {}, ParseOptions options = {}, size_t threads = 0);
+
+#endif //FAST_TEX_PARSER_TEX_PROJECT_H
@@ -0,0 +1,54 @@
+#ifndef FAST_TEX_PARSER_TEX_REWRITE_H
+#define FAST_TEX_PARSER_TEX_REWRITE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "tex_scanner.h"
+
+class TexRewriteRules {
+public:
+	std::map<std::string, std::string> rename_commands;
+	std::map<std::string, std::string> rename_envs;
+	std::vector<std::string> delete_commands;
+	std::vector<std::string> delete_envs;
+	std::map<std::string, uint32_t> replace_with_arg;
+	bool drop_comments = false;
+};
+
+// Applies rewrite rules in a single pass over TeX source, copying untouched regions verbatim
+class TexRewriter {
+public:
+	TexRewriter(std::string_view source, const TexRewriteRules &rules, std::ostream &out);
+
+	void rewrite();
+
+private:
+	TexScanner scanner;
+	std::ostream &out;
+	std::unordered_map<std::string_view, std::string_view> rename_commands;
+	std::unordered_map<std::string_view, std::string_view> rename_envs;
+	std::unordered_set<std::string_view> delete_commands;
+	std::unordered_set<std::string_view> delete_envs;
+	std::unordered_map<std::string_view, uint32_t> replace_with_arg;
+	bool drop_comments;
+
+	inline void _copy(size_t start, size_t end) {
+		out.write(scanner.source.data() + start, end - start);
+	}
+
+	std::vector<TexScannedArg> _read_args(size_t i, size_t end) const;
+
+	void _rewrite_range(size_t start, size_t end);
+};
+
+std::optional<std::string>
+rewrite(std::string_view source, const TexRewriteRules &rules,
+		const std::optional<std::string> &output_path);
+
+#endif //FAST_TEX_PARSER_TEX_REWRITE_H
@@ -0,0 +1,65 @@
+#ifndef FAST_TEX_PARSER_TEX_SCANNER_H
+#define FAST_TEX_PARSER_TEX_SCANNER_H
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <cctype>
+#include <algorithm>
+
+struct TexScannedArg {
+	size_t start;
+	size_t end;
+	char start_delimiter;
+	bool closed;
+
+	inline size_t inner_start() const {
+		return start + 1;
+	}
+
+	inline size_t inner_end() const {
+		return closed ? end - 1 : end;
+	}
+};
+
+// Scans raw TeX source with the same tokenisation rules as the parser, without building elements
+class TexScanner {
+public:
+	std::string_view source;
+
+	explicit TexScanner(std::string_view source) : source(source) {
+	}
+
+	inline static bool is_name_char(char c) {
+		return std::isalnum(static_cast<unsigned char>(c));
+	}
+
+	// i points at a backslash; returns the end of the command name (i + 1 for escaped characters)
+	inline size_t read_command_name(size_t i) const {
+		size_t end = i + 1;
+		while (end < source.size() && is_name_char(source[end]))
+			end++;
+		return end;
+	}
+
+	// i points at a '%'; returns the position after the comment's ending newline
+	inline size_t skip_comment(size_t i) const {
+		size_t end = source.find('\n', i);
+		return end == std::string_view::npos ? source.size() : end + 1;
+	}
+
+	// i points at a '{' or '['; returns the position after the matching end delimiter
+	size_t find_group_end(size_t i, bool *closed = nullptr) const;
+
+	// skips spaces after a command and returns the argument starting there, if any
+	std::optional<TexScannedArg> next_arg(size_t i) const;
+
+	// i is after a \begin{name}; returns the start and end of the matching \end{name}
+	std::pair<size_t, size_t> find_env_end(size_t i, std::string_view name) const;
+
+	inline std::string_view arg_text(const TexScannedArg &arg) const {
+		return source.substr(arg.inner_start(), arg.inner_end() - arg.inner_start());
+	}
+};
+
+#endif //FAST_TEX_PARSER_TEX_SCANNER_H
@@ -0,0 +1,76 @@
+#ifndef FAST_TEX_PARSER_TEX_XREFS_H
+#define FAST_TEX_PARSER_TEX_XREFS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include "tex_element.h"
+
+extern const std::set<std::string, std::less<>> TEX_XREF_REF_COMMANDS;
+
+// commands taking a comma-separated list of labels
+extern const std::set<std::string, std::less<>> TEX_XREF_MULTI_REF_COMMANDS;
+
+extern const std::set<std::string, std::less<>> TEX_XREF_CITE_COMMANDS;
+
+struct TexXref {
+	std::shared_ptr<TexCommand> command;
+	// innermost environment containing the command, other than document
+	std::shared_ptr<TexEnv> env;
+	// sectioning command containing the command, or else the last one before it in the same file
+	std::shared_ptr<TexCommand> section;
+
+	std::string __repr__() const;
+};
+
+class TexXrefs {
+public:
+	std::map<std::string, TexXref> labels;
+	std::map<std::string, std::vector<TexXref>> refs;
+	std::map<std::string, std::vector<TexXref>> cites;
+
+	// adds the entries of another index, keeping existing labels and reporting labels defined in both
+	void merge(const TexXrefs &other, std::vector<TexDiagnostic> &diagnostics);
+};
+
+enum class TexXrefKind : uint8_t {
+	LABEL, REF, CITE
+};
+
+// Collects labels, references and citations as the parser builds commands
+class TexXrefCollector {
+public:
+	void reset();
+
+	void trim(size_t max_retained_bytes);
+
+	void add(const std::shared_ptr<TexCommand> &command);
+
+	std::shared_ptr<TexXrefs> finish(std::vector<TexDiagnostic> &diagnostics);
+
+private:
+	struct Entry {
+		TexXrefKind kind;
+		std::string key;
+		std::shared_ptr<TexCommand> command;
+		std::shared_ptr<TexCommand> section;
+	};
+
+	std::vector<Entry> _entries;
+	std::shared_ptr<TexCommand> _section;
+
+	void _add_keys(TexXrefKind kind, std::string_view keys, bool split,
+			const std::shared_ptr<TexCommand> &command);
+
+	static TexXref _resolve(const Entry &entry);
+};
+
+#endif //FAST_TEX_PARSER_TEX_XREFS_H
@@ -1,25 +1,53 @@
 #include "fast_tex_parser.h"
 
-ParseInfo::ParseInfo() {
+ParseInfo::ParseInfo(ParseOptions options) : options(options) {
 	push_text_delim();
 }
 
+void ParseInfo::reset() {
+	contents.clear();
+	i = 0;
+	line = 0;
+	delimiter.clear();
+	env_child_pushed = false;
+	while (!curr_items.empty())
+		curr_items.pop();
+	parsed_nodes.clear();
+	diagnostics.clear();
+	expansion.reset();
+	xrefs.reset();
+	section_commands.clear();
+	end_cursor = {};
+	push_text_delim();
+}
+
+void ParseInfo::trim(size_t max_retained_bytes) {
+	if (contents.capacity() > max_retained_bytes)
+		std::string().swap(contents);
+	trim_buffer(parsed_nodes, max_retained_bytes);
+	trim_buffer(curr_items.items(), max_retained_bytes);
+	trim_buffer(diagnostics, max_retained_bytes);
+	trim_buffer(section_commands, max_retained_bytes);
+	xrefs.trim(max_retained_bytes);
+}
+
 void ParseInfo::push_text_delim() {
 	curr_text_item = std::make_shared<ParseText>(i, line);
 }
 
-void ParseInfo::_push_element(std::shared_ptr<TexElement> element) {
+void ParseInfo::_push_node(std::shared_ptr<ParseNode> node) {
 	if (!curr_items.empty()) {
-		curr_items.top()->children.push_back(element);
+		if (typeid(*curr_items.top()) == typeid(ParseEnv))
+			env_child_pushed = true;
+		curr_items.top()->children.push_back(std::move(node));
 	} else {
-		parsed_elements.push_back(element);
+		parsed_nodes.push_back(std::move(node));
 	}
 }
 
 void ParseInfo::push_text_element(uint32_t i, uint16_t line) {
 	if (!curr_text_item->text.empty()) {
-		std::shared_ptr<TexElement> element = curr_text_item->build_element(i, line, "", *this);
-		_push_element(element);
+		_push_node(curr_text_item->build_node(i, line, "", *this));
 	}
 }
 
@@ -34,25 +62,148 @@ void ParseInfo::push_delim(std::shared_ptr<ParseItem> parse_item) {
 }
 
 void ParseInfo::push_element(EndDelimiterData end_delimiter) {
-	push_text_element();
 	std::shared_ptr<ParseItem> start = curr_items.top();
+	// text pending when an environment ends came after its \end, so it is left for the parent
+	bool is_env = typeid(*start) == typeid(ParseEnv);
+	if (!is_env)
+		push_text_element();
 	curr_items.pop();
-	std::shared_ptr<TexElement> element = start
-			->build_element(i - (end_delimiter.handles_char ? 0 : 1), line,
-					end_delimiter.end_delimiter, *this);
-	_push_element(element);
-	push_text_delim();
-	if (typeid(*element) == typeid(TexCommand)) {
-		if (!element->children.empty() && typeid(*element->last_child()) == typeid(TexText)) {
-			curr_text_item->text += std::dynamic_pointer_cast<TexText>(element->last_child())->text;
-			element->children.attr("pop")();
-			element->_string = element->_string
-					->substr(0, element->_string.value().size() - curr_text_item->text.size());
-			element->_inner_string = element->_string->substr(element->start_delimiter.size(),
-					element->_string->size() - element->start_delimiter.size() -
-							element->end_delimiter.size());
+	std::shared_ptr<ParseNode> node = start->build_node(i - (end_delimiter.handles_char ? 0 : 1), line,
+			end_delimiter.end_delimiter, *this);
+	if (!is_env)
+		push_text_delim();
+	// text after a command's arguments is not part of it
+	if (node->type == TexElementType::COMMAND && !node->children.empty() &&
+			node->children.back()->type == TexElementType::TEXT) {
+		curr_text_item->text += node->children.back()->contents;
+		node->children.pop_back();
+		node->contents.resize(node->contents.size() - curr_text_item->text.size());
+	}
+	_push_node(std::move(node));
+}
+
+void ParseInfo::close_command(EndDelimiterData end_delimiter) {
+	std::shared_ptr<ParseItem> start = curr_items.top();
+	if (start->start_delimiter == "\\begin") {
+		std::shared_ptr<ParseNode> command = start->build_node(i - 1, line, end_delimiter.end_delimiter,
+				*this);
+		std::shared_ptr<ParseEnv> env;
+		try {
+			env = std::make_shared<ParseEnv>(start->start_pos, start->start_line, *command);
+		} catch (const std::runtime_error &error) {
+			report_error(error.what(), start->start_pos, start->start_line);
+		}
+		if (env) {
+			curr_items.pop();
+			push_delim(env);
+			return;
 		}
 	}
+	push_element(end_delimiter);
+}
+
+bool ParseInfo::close_mismatched_envs() {
+	std::shared_ptr<ParseEnv> env = std::dynamic_pointer_cast<ParseEnv>(curr_items.top());
+	if (!env || env->children.empty())
+		return false;
+	std::optional<std::string> name = ParseEnv::get_ended_name(*env->children.back());
+	if (!name.has_value() || name == env->name)
+		return false;
+
+	// an \end for an environment further down the stack closes the environments opened inside it,
+	// as long as only environments are open in between
+	const std::vector<std::shared_ptr<ParseItem>> &items = curr_items.items();
+	size_t closed = 1;
+	while (closed < items.size() && typeid(*items[items.size() - 1 - closed]) == typeid(ParseEnv) &&
+			static_cast<ParseEnv &>(*items[items.size() - 1 - closed]).name != name)
+		closed++;
+	if (closed == items.size() || typeid(*items[items.size() - 1 - closed]) != typeid(ParseEnv))
+		return false;
+
+	std::shared_ptr<ParseNode> end_command = env->children.back();
+	env->children.pop_back();
+	for (size_t k = 0; k < closed; k++) {
+		std::shared_ptr<ParseItem> start = curr_items.top();
+		curr_items.pop();
+		report_error(start->describe() + " started on line " + std::to_string(start->start_line) +
+				" closed implicitly by \\end{" + name.value() + "} on line " +
+				std::to_string(end_command->start_line), start->start_pos, start->start_line);
+		_push_node(start->build_node(end_command->start_pos - 1, end_command->start_line, "", *this));
+	}
+	curr_items.top()->children.push_back(end_command);
+	return true;
+}
+
+void ParseInfo::report_error(std::string message, uint32_t pos, uint16_t line) {
+	if (!options.recover)
+		throw std::runtime_error(message);
+	diagnostics.push_back(TexDiagnostic{.message = message, .pos = pos, .line = line});
+}
+
+void ParseInfo::close_unclosed_items() {
+	uint32_t end_pos = c == EOF && i > 1 ? i - 2 : i - 1;
+	while (!curr_items.empty()) {
+		std::shared_ptr<ParseItem> start = curr_items.top();
+		curr_items.pop();
+		diagnostics.push_back(TexDiagnostic{.message = "unclosed " + start->describe() + " started on line " +
+				std::to_string(start->start_line), .pos = start->start_pos, .line = start->start_line});
+		if (options.recover) {
+			_push_node(start->build_node(end_pos, line, "", *this));
+			push_text_delim();
+		}
+	}
+}
+
+// like TexElement::_place, for nodes
+static void place_node(ParseNode &node, TexPositionCursor &cursor) {
+	node.start_pos = cursor.pos;
+	node.start_line = cursor.line;
+	if (node.type == TexElementType::TEXT || node.type == TexElementType::COMMENT) {
+		cursor.advance(node.contents);
+	} else {
+		cursor.advance(node.start_delimiter);
+		for (const std::shared_ptr<ParseNode> &child: node.children)
+			place_node(*child, cursor);
+		cursor.advance(node.end_delimiter);
+	}
+	cursor.end(node, node.type == TexElementType::TEXT);
+}
+
+void ParseInfo::place_nodes() {
+	end_cursor = {};
+	for (const std::shared_ptr<ParseNode> &node: parsed_nodes)
+		place_node(*node, end_cursor);
+}
+
+const std::string &ParseInfo::expand_macros(const std::string &source) {
+	if (!options.expand_macros)
+		return source;
+	// expansions made ahead of time, such as by parse_project with the macros of earlier files, are
+	// used as is
+	if (expansion.has_value())
+		return expansion->text;
+	expansion = MacroExpander(source, options.max_expansion_depth, options.max_expansion_size,
+			options.recover).expand();
+	return expansion->text;
+}
+
+// closes the open items that the current character ends, innermost first, and returns whether the
+// character belongs to the last one closed
+static bool close_ended_items(ParseInfo &p) {
+	while (!p.curr_items.empty() && p.curr_items.top()->delim_done) {
+		std::shared_ptr<ParseItem> start = p.curr_items.top();
+		EndDelimiterData end_delimiter = start->get_end_delimiter(p);
+		if (end_delimiter.is_end) {
+			if (typeid(*start) == typeid(ParseCommand))
+				p.close_command(end_delimiter);
+			else
+				p.push_element(end_delimiter);
+			if (end_delimiter.handles_char)
+				return true;
+		} else if (!std::exchange(p.env_child_pushed, false) || !p.close_mismatched_envs())
+			break;
+	}
+	return false;
 }
 
 void process_char(ParseInfo &p, char c) {
@@ -74,19 +225,21 @@ void process_char(ParseInfo &p, char c) {
 		switch (c) {
 			case '\\':
 				char_handled = true;
-				if (!p.curr_items.empty() && typeid(*p.curr_items.top()) == typeid(ParseCommand)) {
-					EndDelimiterData end_delimiter = p.curr_items.top()->get_end_delimiter(p);
-					p.push_element(end_delimiter);
-				}
+				close_ended_items(p);
 				p.push_delim(std::make_shared<ParseCommand>(p.i, p.line, std::string(1, c)));
 				break;
 			case '{':
 			case '[':
 				if (p.curr_items.empty() || (typeid(*p.curr_items.top()) != typeid(ParseComment) &&
-						typeid(*p.curr_items.top()) != typeid(ParseCommand)))
-					throw std::runtime_error("found argument start without command on line " +
-							std::to_string(p.line));
-				if (typeid(*p.curr_items.top()) == typeid(ParseCommand)) {
+						typeid(*p.curr_items.top()) != typeid(ParseCommand))) {
+					p.report_error("found argument start without command on line " +
+							std::to_string(p.line), p.i, p.line);
+					// recover bare groups as arguments without a command, and brackets as text
+					if (c == '{') {
+						p.push_delim(std::make_shared<ParseArg>(p.i, p.line, std::string(1, c)));
+						char_handled = true;
+					}
+				} else if (typeid(*p.curr_items.top()) == typeid(ParseCommand)) {
 					p.push_delim(std::make_shared<ParseArg>(p.i, p.line, std::string(1, c)));
 					char_handled = true;
 				}
@@ -98,21 +251,8 @@ void process_char(ParseInfo &p, char c) {
 		}
 	}
 
-	while (!char_handled && !p.curr_items.empty() && p.curr_items.top()->delim_done) {
-		std::shared_ptr<ParseItem> start = p.curr_items.top();
-		EndDelimiterData end_delimiter = start->get_end_delimiter(p);
-		if (end_delimiter.is_end) {
-			if ((typeid(*start) == typeid(ParseCommand)) && (start->start_delimiter == "\\begin")) {
-				std::shared_ptr<TexCommand> command = std::dynamic_pointer_cast<TexCommand>(
-						start->build_element(p.i - 1, p.line, end_delimiter.end_delimiter, p));
-				p.curr_items.pop();
-				p.push_delim(std::make_shared<ParseEnv>(p.i, p.line, command));
-			} else
-				p.push_element(end_delimiter);
-			char_handled = end_delimiter.handles_char;
-		} else
-			break;
-	}
+	if (!char_handled)
+		char_handled = close_ended_items(p);
 
 	if (!char_handled && c != EOF) {
 		p.curr_text_item->text += c;
@@ -123,90 +263,417 @@ void process_char(ParseInfo &p, char c) {
 		p.line++;
 }
 
-TexRoot handle_file_end(ParseInfo &p) {
+// like TexElement::adopt_children, but from the built children rather than the Python list
+static void set_parent(const std::shared_ptr<TexElement> &parent,
+		const std::vector<std::shared_ptr<TexElement>> &children) {
+	for (size_t i = 0; i < children.size(); i++) {
+		children[i]->parent = parent;
+		children[i]->_index_in_parent = i;
+	}
+}
+
+std::shared_ptr<TexElement> ParseInfo::build_element(ParseNode &node) {
+	std::vector<std::shared_ptr<TexElement>> children;
+	children.reserve(node.children.size());
+	for (const std::shared_ptr<ParseNode> &child: node.children)
+		children.push_back(build_element(*child));
+
+	std::shared_ptr<TexElement> element;
+	switch (node.type) {
+		case TexElementType::COMMAND: {
+			std::shared_ptr<TexCommand> command = std::make_shared<TexCommand>(node.start_pos,
+					node.start_line, node.end_pos, node.end_line, std::move(node.start_delimiter),
+					std::move(node.end_delimiter), std::move(node.contents), children,
+					std::move(node.name));
+			// elements are built children first, in the order the parser closed them
+			if (options.xrefs)
+				xrefs.add(command);
+			if (options.outline && TEX_SECTION_LEVELS.contains(command->name))
+				section_commands.push_back(command);
+			element = command;
+			break;
+		}
+		case TexElementType::ARG:
+			element = std::make_shared<TexArg>(node.start_pos, node.start_line, node.end_pos, node.end_line,
+					std::move(node.start_delimiter), std::move(node.end_delimiter), std::move(node.contents),
+					children);
+			break;
+		case TexElementType::ENV:
+			element = std::make_shared<TexEnv>(node.start_pos, node.start_line, node.end_pos, node.end_line,
+					std::move(node.start_delimiter), std::move(node.end_delimiter), std::move(node.contents),
+					children, std::move(node.name));
+			break;
+		case TexElementType::COMMENT:
+			element = std::make_shared<TexComment>(node.start_pos, node.start_line, node.end_pos,
+					node.end_line, std::move(node.start_delimiter), std::move(node.end_delimiter),
+					std::move(node.contents));
+			break;
+		default:
+			element = std::make_shared<TexText>(node.start_pos, node.start_line, node.end_pos, node.end_line,
+					std::move(node.contents));
+			break;
+	}
+	set_parent(element, children);
+	element->update_hash();
+	return element;
+}
+
+void finish_parse(ParseInfo &p) {
 	p.push_text_element();
+	p.push_text_delim();
+	p.close_unclosed_items();
+	p.place_nodes();
+}
 
-	if (!p.curr_items.empty()) {
-		std::cout << "remaining: " << p.curr_items.size() << "\n";
-		std::cout << "top: " << p.curr_items.top()->build_element(p.i, p.line, "", p)
-				->repr() << "\n";
+std::shared_ptr<TexRoot> build_root(ParseInfo &p) {
+	std::vector<std::shared_ptr<TexElement>> elements;
+	elements.reserve(p.parsed_nodes.size());
+	for (const std::shared_ptr<ParseNode> &node: p.parsed_nodes)
+		elements.push_back(p.build_element(*node));
+	p.parsed_nodes.clear();
+
+	std::shared_ptr<TexRoot> root = std::make_shared<TexRoot>(p.end_cursor.pos, p.end_cursor.line,
+			p.contents, elements);
+	p.end_cursor.end(*root, false);
+	root->diagnostics = std::move(p.diagnostics);
+	if (p.expansion.has_value())
+		p.expansion->apply(*root);
+	set_parent(root, elements);
+	root->update_hash();
+	if (p.options.xrefs)
+		root->xrefs = p.xrefs.finish(root->diagnostics);
+	if (p.options.outline) {
+		root->outline = build_outline(p.section_commands);
+		p.section_commands.clear();
 	}
+	return root;
+}
 
-	return TexRoot(p.i, p.line, p.contents, p.parsed_elements);
+std::shared_ptr<TexRoot> handle_file_end(ParseInfo &p) {
+	finish_parse(p);
+	return build_root(p);
 }
 
-TexRoot parse_file(std::string filename) {
-	ParseInfo p;
+void process_string(ParseInfo &p, const std::string &string) {
+	const std::string &text = p.expand_macros(string);
+	p.contents.reserve(p.contents.size() + text.size() + 1);
+	for (char c: text)
+		process_char(p, c);
+	process_char(p, EOF);
+}
+
+void process_file(ParseInfo &p, const std::string &filename) {
 	std::ifstream file(filename);
 
-	if (file.is_open()) {
+	if (file.is_open() && p.options.expand_macros) {
+		process_string(p, std::string(std::istreambuf_iterator<char>(file),
+				std::istreambuf_iterator<char>()));
+	} else if (file.is_open()) {
 		while (file.good()) {
 			process_char(p, file.get());
 		}
 	}
+}
+
+std::shared_ptr<TexRoot> parse_file(std::string filename, ParseOptions options) {
+	ParseInfo p(options);
+	process_file(p, filename);
+	return handle_file_end(p);
+}
 
+std::shared_ptr<TexRoot> parse(std::string string, ParseOptions options) {
+	ParseInfo p(options);
+	process_string(p, string);
 	return handle_file_end(p);
 }
 
-TexRoot parse(std::string string) {
-	ParseInfo p;
-	string += EOF;
+Parser::Parser(ParseOptions options, size_t max_retained_bytes) : max_retained_bytes(
+		max_retained_bytes), _info(options) {
+}
 
-	for (char &c: string)
-		process_char(p, c);
+std::shared_ptr<TexRoot> Parser::_finish() {
+	std::shared_ptr<TexRoot> root = handle_file_end(_info);
+	_info.reset();
+	_info.trim(max_retained_bytes);
+	return root;
+}
 
-	return handle_file_end(p);
+std::shared_ptr<TexRoot> Parser::parse(const std::string &string) {
+	_info.reset();
+	process_string(_info, string);
+	return _finish();
+}
+
+std::shared_ptr<TexRoot> Parser::parse_file(const std::string &filename) {
+	_info.reset();
+	process_file(_info, filename);
+	return _finish();
+}
+
+template<typename T>
+void bind_column(py::module &m, const char *name) {
+	py::class_<TexColumn<T>, std::shared_ptr<TexColumn<T>>>(m, name, py::buffer_protocol())
+			.def_buffer(&TexColumn<T>::buffer).def("__len__", &TexColumn<T>::size);
+}
+
+template<typename T, typename... Args>
+std::shared_ptr<T> make_element(Args... args) {
+	std::shared_ptr<T> element = std::make_shared<T>(args...);
+	element->adopt_children();
+	element->update_hash();
+	return element;
+}
+
+template<typename T>
+auto pickle_element() {
+	return py::pickle([](T &element) {
+		return py::bytes(encode_tree(element));
+	}, [](const py::bytes &state) {
+		std::shared_ptr<T> element = std::dynamic_pointer_cast<T>(decode_tree(std::string(state)));
+		if (!element)
+			throw std::runtime_error("pickled TeX element has the wrong type");
+		return element;
+	});
 }
 
 PYBIND11_MODULE(fast_tex_parser, m) {
 	m.doc() = "Fast TeX parser";
 
-	m.def("parse", &parse);
-	m.def("parse_file", &parse_file);
+	m.def("parse", [](std::string string, bool recover, bool expand_macros, size_t max_expansion_depth,
+			size_t max_expansion_size, bool xrefs, bool outline) {
+		return parse(string, ParseOptions{recover, expand_macros, max_expansion_depth, max_expansion_size, xrefs,
+				outline});
+	}, py::arg("string"), py::arg("recover") = false, py::kw_only(), py::arg("expand_macros") = false,
+			py::arg("max_expansion_depth") = 64, py::arg("max_expansion_size") = 1 << 26,
+			py::arg("xrefs") = false, py::arg("outline") = false);
+	m.def("parse_file", [](std::string path, bool recover, bool expand_macros, size_t max_expansion_depth,
+			size_t max_expansion_size, bool xrefs, bool outline) {
+		return parse_file(path, ParseOptions{recover, expand_macros, max_expansion_depth, max_expansion_size, xrefs,
+				outline});
+	}, py::arg("path"), py::arg("recover") = false, py::kw_only(), py::arg("expand_macros") = false,
+			py::arg("max_expansion_depth") = 64, py::arg("max_expansion_size") = 1 << 26,
+			py::arg("xrefs") = false, py::arg("outline") = false);
+	m.def("parse_project", [](std::string main_tex, std::vector<std::string> search_paths, size_t threads,
+			bool recover, bool expand_macros, size_t max_expansion_depth, size_t max_expansion_size, bool xrefs,
+			bool outline) {
+		return parse_project(main_tex, search_paths, ParseOptions{recover, expand_macros, max_expansion_depth,
+				max_expansion_size, xrefs, outline}, threads);
+	}, py::arg("main_tex"), py::arg("search_paths") = std::vector<std::string>(), py::arg("threads") = 0,
+			py::arg("recover") = false, py::kw_only(), py::arg("expand_macros") = false,
+			py::arg("max_expansion_depth") = 64, py::arg("max_expansion_size") = 1 << 26,
+			py::arg("xrefs") = false, py::arg("outline") = false);
+
+	m.def("rewrite", [](const std::string &source, const TexRewriteRules &rules,
+			const std::optional<std::string> &output_path) {
+		return rewrite(source, rules, output_path);
+	}, py::arg("source"), py::arg("rules"), py::arg("output_path") = py::none(),
+			py::call_guard<py::gil_scoped_release>());
+	m.def("rewrite", [](const std::shared_ptr<TexElement> &element, const TexRewriteRules &rules,
+			const std::optional<std::string> &output_path) {
+		if (element->from_macro)
+			throw std::invalid_argument("cannot rewrite an element produced by a macro use, as its source is "
+					"not kept; rewrite the source it was parsed from instead");
+		std::string source = element->string();
+		py::gil_scoped_release release;
+		return rewrite(source, rules, output_path);
+	}, py::arg("element"), py::arg("rules"), py::arg("output_path") = py::none());
+	m.def("parse_async", [](std::string string, bool recover, bool expand_macros, size_t max_expansion_depth,
+			size_t max_expansion_size, bool xrefs, bool outline) {
+		return ParsePool::get_default().submit(string, false, ParseOptions{recover, expand_macros,
+				max_expansion_depth, max_expansion_size, xrefs, outline});
+	}, py::arg("string"), py::arg("recover") = false, py::kw_only(), py::arg("expand_macros") = false,
+			py::arg("max_expansion_depth") = 64, py::arg("max_expansion_size") = 1 << 26,
+			py::arg("xrefs") = false, py::arg("outline") = false);
+	m.def("parse_file_async", [](std::string path, bool recover, bool expand_macros, size_t max_expansion_depth,
+			size_t max_expansion_size, bool xrefs, bool outline) {
+		return ParsePool::get_default().submit(path, true, ParseOptions{recover, expand_macros,
+				max_expansion_depth, max_expansion_size, xrefs, outline});
+	}, py::arg("path"), py::arg("recover") = false, py::kw_only(), py::arg("expand_macros") = false,
+			py::arg("max_expansion_depth") = 64, py::arg("max_expansion_size") = 1 << 26,
+			py::arg("xrefs") = false, py::arg("outline") = false);
+	m.def("configure_async", &ParsePool::configure_default, py::arg("threads") = 0,
+			py::arg("max_queued") = 1024);
+
+	py::class_<Parser>(m, "Parser")
+			.def(py::init([](bool recover, size_t max_retained_bytes, bool expand_macros,
+					size_t max_expansion_depth, size_t max_expansion_size, bool xrefs, bool outline) {
+				return Parser(ParseOptions{recover, expand_macros, max_expansion_depth, max_expansion_size, xrefs,
+						outline}, max_retained_bytes);
+			}), py::arg("recover") = false, py::arg("max_retained_bytes") = 1 << 20, py::kw_only(),
+					py::arg("expand_macros") = false, py::arg("max_expansion_depth") = 64,
+					py::arg("max_expansion_size") = 1 << 26, py::arg("xrefs") = false, py::arg("outline") = false)
+			.def("parse", &Parser::parse, py::arg("string"))
+			.def("parse_file", &Parser::parse_file, py::arg("path"))
+			.def_readwrite("max_retained_bytes", &Parser::max_retained_bytes);
+	m.def("diff", &diff, py::arg("a"), py::arg("b"));
+	m.def("find_duplicates", &find_duplicates, py::arg("elements"), py::arg("min_nodes") = 8);
+	m.def("find_duplicates", [](const std::shared_ptr<TexElement> &element, uint32_t min_nodes) {
+		return find_duplicates({element}, min_nodes);
+	}, py::arg("element"), py::arg("min_nodes") = 8);
+	m.def("to_plaintext", &to_plaintext, py::arg("source"),
+			py::arg("keep_args_of") = std::vector<std::string>(),
+			py::arg("drop_envs") = std::vector<std::string>(), py::arg("offsets") = false,
+			py::call_guard<py::gil_scoped_release>());
 
 	py::class_<TexElement, std::shared_ptr<TexElement>> tex_element(m, "TexElement");
 	tex_element.def("__repr__", &TexElement::__repr__).def("__str__", &TexElement::string)
+			.def("repr", &TexElement::repr_truncated, py::arg("max_depth") = py::none(),
+					py::arg("max_length") = py::none())
 			.def("find_command", py::overload_cast<std::string>(&TexElement::find_command))
 			.def("find_command",
 					py::overload_cast<std::vector<std::string>>(&TexElement::find_command))
 			.def("find_commands", &TexElement::find_commands).def("find_env", &TexElement::find_env)
-			.def("find_envs", &TexElement::find_envs)
-			.def_readwrite("children", &TexElement::children)
+			.def("find_envs", &TexElement::find_envs).def("to_columns", &TexElement::to_columns)
+			.def_property("children", [](TexElement &element) {
+				// as for TexCommand::get_args
+				element._invalidate_hash();
+				return element.children;
+			}, &TexElement::set_children)
+			.def_property_readonly("parent", &TexElement::get_parent)
+			.def_property_readonly("structural_hash", &TexElement::get_structural_hash)
+			.def_property_readonly("source_file", [](const TexElement &element) {
+				return element.source_file ? std::optional<std::string>(*element.source_file) : std::nullopt;
+			})
+			.def_readonly("from_macro", &TexElement::from_macro)
+			.def("replace_with", &TexElement::replace_with, py::arg("element"))
+			.def("remove", &TexElement::remove)
+			.def("insert_before", &TexElement::insert_before, py::arg("element"))
+			.def("insert_after", &TexElement::insert_after, py::arg("element"))
+			.def("unwrap", &TexElement::unwrap)
 			.def_property_readonly("string", &TexElement::inner_string)
 			.def_property_readonly("outer_string", &TexElement::string)
-			.def_readonly("start_line", &TexElement::start_line)
-			.def_readonly("end_line", &TexElement::end_line)
-			.def_readonly("start_pos", &TexElement::start_pos)
-			.def_readonly("end_pos", &TexElement::end_pos);
+			.def_property_readonly("start_line", &TexElement::get_start_line)
+			.def_property_readonly("end_line", &TexElement::get_end_line)
+			.def_property_readonly("start_pos", &TexElement::get_start_pos)
+			.def_property_readonly("end_pos", &TexElement::get_end_pos);
 
 	py::class_<TexCommand, std::shared_ptr<TexCommand>>(m, "TexCommand", tex_element)
-			.def(py::init<const std::string &, const py::list &>(), py::arg("name"),
-					py::arg("args") = py::list())
+			.def(py::init(&make_element<TexCommand, const std::string &, const py::list &>),
+					py::arg("name"), py::arg("args") = py::list())
 			.def_property("name", &TexCommand::get_name, &TexCommand::set_name)
-			.def_readwrite("args", &TexCommand::args);
+			.def_property("args", &TexCommand::get_args, &TexCommand::set_args)
+			.def(pickle_element<TexCommand>());
 
 	py::class_<TexArg, std::shared_ptr<TexArg>>(m, "TexArg", tex_element)
-			.def(py::init<const std::string &, const std::string &, const py::list &>(),
-					py::arg("start_delim") = "{", py::arg("end_delim") = "}",
-					py::arg("children") = py::list())
-			.def_readwrite("start_delim", &TexArg::start_delimiter)
-			.def_readwrite("end_delim", &TexArg::end_delimiter);
+			.def(py::init(&make_element<TexArg, const std::string &, const std::string &,
+							const py::list &>), py::arg("start_delim") = "{",
+					py::arg("end_delim") = "}", py::arg("children") = py::list())
+			.def_property("start_delim", &TexArg::get_start_delimiter, &TexArg::set_start_delimiter)
+			.def_property("end_delim", &TexArg::get_end_delimiter, &TexArg::set_end_delimiter)
+			.def(pickle_element<TexArg>());
 
 	py::class_<TexEnv, std::shared_ptr<TexEnv>>(m, "TexEnv", tex_element)
-			.def(py::init<const std::string &, const py::list &>(), py::arg("name"),
-					py::arg("children") = py::list())
-			.def_property("name", &TexEnv::get_name, &TexEnv::set_name);
+			.def(py::init(&make_element<TexEnv, const std::string &, const py::list &>),
+					py::arg("name"), py::arg("children") = py::list())
+			.def_property("name", &TexEnv::get_name, &TexEnv::set_name)
+			.def(pickle_element<TexEnv>());
 
 	py::class_<TexComment, std::shared_ptr<TexComment>>(m, "TexComment", tex_element)
-			.def(py::init<const std::string &>(), py::arg("text"))
-			.def_readwrite("text", &TexComment::text)
-			.def_readwrite("end_delim", &TexArg::end_delimiter);;
+			.def(py::init(&make_element<TexComment, const std::string &>), py::arg("text"))
+			.def_property("text", &TexComment::get_text, &TexComment::set_text)
+			.def_property("end_delim", &TexComment::get_end_delimiter, &TexComment::set_end_delimiter)
+			.def(pickle_element<TexComment>());
 
 	py::class_<TexText, std::shared_ptr<TexText>>(m, "TexText", tex_element)
-			.def(py::init<const std::string &>(), py::arg("text"))
-			.def_readwrite("text", &TexText::text);
+			.def(py::init(&make_element<TexText, const std::string &>), py::arg("text"))
+			.def_property("text", &TexText::get_text, &TexText::set_text).def(pickle_element<TexText>());
 
 	py::class_<TexRoot, std::shared_ptr<TexRoot>>(m, "TexRoot", tex_element)
-			.def(py::init<const py::list &>(), py::arg("children") = py::list())
-			.def_readonly("length", &TexRoot::length).def_readonly("lines", &TexRoot::lines);
+			.def(py::init(&make_element<TexRoot, const py::list &>),
+					py::arg("children") = py::list())
+			.def_property_readonly("length", [](TexRoot &root) {
+				root.update_positions();
+				return root.length;
+			})
+			.def_property_readonly("lines", [](TexRoot &root) {
+				root.update_positions();
+				return root.lines;
+			})
+			.def_readonly("diagnostics", &TexRoot::diagnostics)
+			.def_readonly("macros", &TexRoot::macros).def_readonly("xrefs", &TexRoot::xrefs)
+			.def_readonly("outline", &TexRoot::outline).def(pickle_element<TexRoot>());
+
+	py::class_<TexMacro>(m, "TexMacro").def("__repr__", &TexMacro::__repr__)
+			.def_readonly("name", &TexMacro::name).def_readonly("num_args", &TexMacro::num_args)
+			.def_readonly("default_arg", &TexMacro::default_arg).def_readonly("body", &TexMacro::body)
+			.def_readonly("pos", &TexMacro::pos);
+
+	py::class_<TexXref>(m, "TexXref").def("__repr__", &TexXref::__repr__)
+			.def_readonly("command", &TexXref::command).def_readonly("env", &TexXref::env)
+			.def_readonly("section", &TexXref::section);
+
+	py::class_<TexXrefs, std::shared_ptr<TexXrefs>>(m, "TexXrefs")
+			.def_readonly("labels", &TexXrefs::labels).def_readonly("refs", &TexXrefs::refs)
+			.def_readonly("cites", &TexXrefs::cites);
+
+	py::class_<TexChildrenView>(m, "TexChildrenView").def("__repr__", &TexChildrenView::__repr__)
+			.def("__len__", &TexChildrenView::size).def("__getitem__", &TexChildrenView::get)
+			.def("__iter__", [](const TexChildrenView &view) {
+				return py::iter(view.to_list());
+			}).def("__str__", &TexChildrenView::string)
+			.def_property_readonly("string", &TexChildrenView::string)
+			.def("to_list", &TexChildrenView::to_list)
+			.def_readonly("parent", &TexChildrenView::element)
+			.def_property_readonly("start", &TexChildrenView::start)
+			.def_property_readonly("end", &TexChildrenView::end);
+
+	py::class_<TexSection, std::shared_ptr<TexSection>>(m, "TexSection").def("__repr__", &TexSection::__repr__)
+			.def_readonly("command", &TexSection::command).def_readonly("level", &TexSection::level)
+			.def_readonly("title", &TexSection::title)
+			.def_readonly("start_pos", &TexSection::start_pos).def_readonly("end_pos", &TexSection::end_pos)
+			.def_readonly("start_line", &TexSection::start_line)
+			.def_readonly("end_line", &TexSection::end_line)
+			.def_readonly("content", &TexSection::content)
+			.def_readonly("subsections", &TexSection::subsections);
+
+	py::class_<TexOutline, std::shared_ptr<TexOutline>>(m, "TexOutline")
+			.def_readonly("sections", &TexOutline::sections)
+			.def_readonly("all_sections", &TexOutline::all_sections);
+
+	py::class_<TexDiff>(m, "TexDiff").def("__repr__", &TexDiff::__repr__)
+			.def_readonly("inserted", &TexDiff::inserted).def_readonly("deleted", &TexDiff::deleted)
+			.def_readonly("modified", &TexDiff::modified);
+
+	py::class_<TexDiagnostic>(m, "TexDiagnostic").def("__repr__", &TexDiagnostic::__repr__)
+			.def_readonly("message", &TexDiagnostic::message).def_readonly("pos", &TexDiagnostic::pos)
+			.def_readonly("line", &TexDiagnostic::line);
+
+	bind_column<uint8_t>(m, "TexColumnUInt8");
+	bind_column<uint16_t>(m, "TexColumnUInt16");
+	bind_column<uint32_t>(m, "TexColumnUInt32");
+	bind_column<int32_t>(m, "TexColumnInt32");
+
+	py::class_<TexColumns, std::shared_ptr<TexColumns>>(m, "TexColumns")
+			.def_readonly("type", &TexColumns::type).def_readonly("name", &TexColumns::name)
+			.def_readonly("start_pos", &TexColumns::start_pos)
+			.def_readonly("end_pos", &TexColumns::end_pos).def_readonly("line", &TexColumns::line)
+			.def_readonly("depth", &TexColumns::depth).def_readonly("parent", &TexColumns::parent)
+			.def_readonly("names", &TexColumns::names)
+			.def_readonly_static("type_names", &TEX_ELEMENT_TYPE_NAMES)
+			.def("__len__", &TexColumns::size);
+
+	py::class_<TexRewriteRules>(m, "TexRewriteRules")
+			.def(py::init([](std::map<std::string, std::string> rename_commands,
+					std::map<std::string, std::string> rename_envs,
+					std::vector<std::string> delete_commands, std::vector<std::string> delete_envs,
+					std::map<std::string, uint32_t> replace_with_arg, bool drop_comments) {
+				return TexRewriteRules{.rename_commands = rename_commands, .rename_envs = rename_envs,
+						.delete_commands = delete_commands, .delete_envs = delete_envs,
+						.replace_with_arg = replace_with_arg, .drop_comments = drop_comments};
+			}), py::arg("rename_commands") = std::map<std::string, std::string>(),
+					py::arg("rename_envs") = std::map<std::string, std::string>(),
+					py::arg("delete_commands") = std::vector<std::string>(),
+					py::arg("delete_envs") = std::vector<std::string>(),
+					py::arg("replace_with_arg") = std::map<std::string, uint32_t>(),
+					py::arg("drop_comments") = false)
+			.def_readwrite("rename_commands", &TexRewriteRules::rename_commands)
+			.def_readwrite("rename_envs", &TexRewriteRules::rename_envs)
+			.def_readwrite("delete_commands", &TexRewriteRules::delete_commands)
+			.def_readwrite("delete_envs", &TexRewriteRules::delete_envs)
+			.def_readwrite("replace_with_arg", &TexRewriteRules::replace_with_arg)
+			.def_readwrite("drop_comments", &TexRewriteRules::drop_comments);
+
+	py::class_<TexPlaintext, std::shared_ptr<TexPlaintext>>(m, "TexPlaintext")
+			.def_readonly("text", &TexPlaintext::text)
+			.def_readonly("offsets", &TexPlaintext::offsets);
 }
@@ -8,6 +8,13 @@ inline bool ends_with(std::string const &value, std::string const &ending) {
 	return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
 }
 
+const ParseNode *ParseNode::last_arg() const {
+	for (size_t i = children.size(); i-- > 0;)
+		if (children[i]->type == TexElementType::ARG)
+			return children[i].get();
+	return nullptr;
+}
+
 ParseItem::ParseItem(uint32_t pos, uint16_t line, std::string delimiter) {
 	start_pos = pos;
 	start_line = line;
@@ -26,15 +33,17 @@ EndDelimiterData ParseCommand::get_end_delimiter(const ParseInfo &p) {
 	return EndDelimiterData{.is_end = false};
 }
 
-std::shared_ptr<TexElement>
-ParseCommand::build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+std::shared_ptr<ParseNode>
+ParseCommand::build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 		const ParseInfo &p) {
 	std::string name;
 	if (!start_delimiter.empty())
 		name = start_delimiter.substr(1);
 
-	return std::make_shared<TexCommand>(start_pos, start_line, end_pos, end_line, start_delimiter,
-			end_delimiter, p.get_contents_between(start_pos, end_pos), children, name);
+	return std::make_shared<ParseNode>(ParseNode{.type = TexElementType::COMMAND, .start_pos = start_pos,
+			.start_line = start_line, .end_pos = end_pos, .end_line = end_line,
+			.start_delimiter = start_delimiter, .end_delimiter = end_delimiter,
+			.contents = p.get_contents_between(start_pos, end_pos), .name = name, .children = children});
 }
 
 bool ParseCommand::check_start_delim_done(char c) {
@@ -49,51 +58,52 @@ EndDelimiterData ParseArg::get_end_delimiter(const ParseInfo &p) {
 	return EndDelimiterData{.is_end = false};
 }
 
-std::shared_ptr<TexElement>
-ParseArg::build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+std::shared_ptr<ParseNode>
+ParseArg::build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 		const ParseInfo &p) {
-	return std::make_shared<TexArg>(start_pos, start_line, end_pos, end_line, start_delimiter,
-			end_delimiter, p.get_contents_between(start_pos, end_pos), children);
+	return std::make_shared<ParseNode>(ParseNode{.type = TexElementType::ARG, .start_pos = start_pos,
+			.start_line = start_line, .end_pos = end_pos, .end_line = end_line,
+			.start_delimiter = start_delimiter, .end_delimiter = end_delimiter,
+			.contents = p.get_contents_between(start_pos, end_pos), .children = children});
+}
+
+ParseEnv::ParseEnv(uint32_t pos, uint16_t line, const ParseNode &start_command)
+		: ParseItem(pos, line, start_command.contents) {
+	const ParseNode *arg = start_command.last_arg();
+	if (arg == nullptr)
+		throw std::runtime_error("wrong argument for ParseEnv start TextCommand: " + start_command.contents);
+	if (arg->children.empty() || arg->children.back()->type != TexElementType::TEXT)
+		throw std::runtime_error("wrong text for ParseEnv start TextCommand: " + start_command.contents);
+	name = arg->children.back()->contents;
+	// the \begin command is the whole start delimiter, so it is already done
+	delim_done = true;
 }
 
-ParseEnv::ParseEnv(uint32_t pos, uint16_t line, std::shared_ptr<TexCommand> start_command)
-		: ParseItem(pos, line, start_command->string()) {
-	if (start_command->args.empty() || typeid(*start_command->last_arg()) != typeid(TexArg))
-		throw std::runtime_error(
-				"wrong argument for ParseEnv start TextCommand: " + start_command->repr());
-	std::shared_ptr<TexArg> arg = start_command->last_arg();
-	if (arg->children.empty() || typeid(*arg->last_child()) != typeid(TexText))
-		throw std::runtime_error("wrong text for ParseEnv start TextCommand: " +
-				std::string(typeid(*arg->last_child()).name()));
-	name = std::dynamic_pointer_cast<TexText>(start_command->last_arg()->last_child())->text;
+std::optional<std::string> ParseEnv::get_ended_name(const ParseNode &node) {
+	if (node.type != TexElementType::COMMAND || node.name != "end")
+		return {};
+	const ParseNode *arg = node.last_arg();
+	if (arg == nullptr || arg->children.empty() || arg->children.back()->type != TexElementType::TEXT)
+		return {};
+	return arg->children.back()->contents;
 }
 
 EndDelimiterData ParseEnv::get_end_delimiter(const ParseInfo &p) {
-	if (!children.empty() && typeid(*children.back()) == typeid(TexCommand)) {
-//		std::cout << "FOUND COMMAND\n";
-		std::shared_ptr<TexCommand> end_command = std::dynamic_pointer_cast<TexCommand>(
-				children.back());
-		if (end_command->name == "end" && !end_command->args.empty() &&
-				typeid(*end_command->last_arg()) == typeid(TexArg)) {
-			std::shared_ptr<TexArg> first_arg = std::dynamic_pointer_cast<TexArg>(
-					end_command->last_arg());
-			if (!first_arg->children.empty() &&
-					typeid(*first_arg->last_child()) == typeid(TexText) &&
-					std::dynamic_pointer_cast<TexText>(first_arg->last_child())->text == name) {
-				std::string end_delimiter = children.back()->string();
-				children.pop_back();
-				return EndDelimiterData{.end_delimiter = end_delimiter, .is_end = true, .handles_char = false};
-			}
-		}
+	if (!children.empty() && get_ended_name(*children.back()) == name) {
+		std::string end_delimiter = children.back()->contents;
+		children.pop_back();
+		return EndDelimiterData{.end_delimiter = end_delimiter, .is_end = true, .handles_char = false};
 	}
 	return EndDelimiterData{.is_end = false};
 }
 
-std::shared_ptr<TexElement>
-ParseEnv::build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+std::shared_ptr<ParseNode>
+ParseEnv::build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 		const ParseInfo &p) {
-	return std::make_shared<TexEnv>(start_pos, start_line, end_pos, end_line, start_delimiter,
-			end_delimiter, p.get_contents_between(start_pos, end_pos), children, name);
+	return std::make_shared<ParseNode>(ParseNode{.type = TexElementType::ENV, .start_pos = start_pos,
+			.start_line = start_line, .end_pos = end_pos, .end_line = end_line,
+			.start_delimiter = start_delimiter, .end_delimiter = end_delimiter,
+			.contents = p.get_contents_between(start_pos, end_pos), .name = name, .children = children});
 }
 
 EndDelimiterData ParseComment::get_end_delimiter(const ParseInfo &p) {
@@ -102,11 +112,13 @@ EndDelimiterData ParseComment::get_end_delimiter(const ParseInfo &p) {
 	return EndDelimiterData{.is_end = false};
 }
 
-std::shared_ptr<TexElement>
-ParseComment::build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+std::shared_ptr<ParseNode>
+ParseComment::build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 		const ParseInfo &p) {
-	return std::make_shared<TexComment>(start_pos, start_line, end_pos, end_line, start_delimiter,
-			end_delimiter, p.get_contents_between(start_pos, end_pos));
+	return std::make_shared<ParseNode>(ParseNode{.type = TexElementType::COMMENT, .start_pos = start_pos,
+			.start_line = start_line, .end_pos = end_pos, .end_line = end_line,
+			.start_delimiter = start_delimiter, .end_delimiter = end_delimiter,
+			.contents = p.get_contents_between(start_pos, end_pos)});
 }
 
 ParseText::ParseText(uint32_t pos, uint16_t line) : ParseItem(pos, line, "") {
@@ -116,9 +128,10 @@ EndDelimiterData ParseText::get_end_delimiter(const ParseInfo &p) {
 	return EndDelimiterData{.is_end = false};
 }
 
-std::shared_ptr<TexElement>
-ParseText::build_element(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
+std::shared_ptr<ParseNode>
+ParseText::build_node(uint32_t end_pos, uint16_t end_line, std::string end_delimiter,
 		const ParseInfo &p) {
-	return std::make_shared<TexText>(start_pos, start_line, end_pos, end_line, text);
+	return std::make_shared<ParseNode>(ParseNode{.type = TexElementType::TEXT, .start_pos = start_pos,
+			.start_line = start_line, .end_pos = end_pos, .end_line = end_line, .contents = text});
 }
 
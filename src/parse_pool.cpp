@@ -0,0 +1,168 @@
+#include "parse_pool.h"
+
+static size_t default_threads = 0;
+static size_t default_max_queued = 1024;
+static ParsePool *default_pool = nullptr;
+
+ParsePool::ParsePool(size_t threads, size_t max_queued) : _max_queued(max_queued) {
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	for (size_t i = 0; i < threads; i++)
+		_threads.emplace_back(&ParsePool::_work, this);
+}
+
+ParsePool::~ParsePool() {
+	// called with the GIL held, which the workers need to finish the documents they are parsing
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_all();
+	{
+		py::gil_scoped_release release;
+		for (std::thread &thread: _threads)
+			thread.join();
+	}
+	// documents still queued are dropped, and their futures are never resolved
+	_queue.clear();
+}
+
+ParsePool &ParsePool::get_default() {
+	if (default_pool == nullptr) {
+		// stopped before the interpreter shuts down, while workers can still take the GIL
+		py::module_::import("atexit").attr("register")(py::cpp_function(&ParsePool::shutdown_default));
+		default_pool = new ParsePool(default_threads, default_max_queued);
+	}
+	return *default_pool;
+}
+
+void ParsePool::configure_default(size_t threads, size_t max_queued) {
+	if (default_pool != nullptr)
+		throw std::runtime_error("async parse pool has already been started");
+	default_threads = threads;
+	default_max_queued = max_queued;
+}
+
+void ParsePool::shutdown_default() {
+	delete default_pool;
+	default_pool = nullptr;
+}
+
+py::object ParsePool::submit(std::string source, bool is_file, ParseOptions options) {
+	py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+	// checked before the future is created, so that a full queue leaves no pending future behind.
+	// Other submitters hold the GIL as well, so the queue can only shrink until the job is added.
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_queue.size() >= _max_queued)
+			throw std::runtime_error(
+					"async parse queue is full (" + std::to_string(_max_queued) + " documents)");
+	}
+
+	py::object future = loop.attr("create_future")();
+	std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+	future.attr("add_done_callback")(py::cpp_function([cancelled](py::object future) {
+		if (future.attr("cancelled")().cast<bool>())
+			cancelled->store(true);
+	}));
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(ParseJob{.source = std::move(source), .is_file = is_file, .options = options,
+				.loop = loop, .future = future, .cancelled = cancelled});
+	}
+	_condition.notify_one();
+	return future;
+}
+
+void ParsePool::_work() {
+	ParseInfo p;
+	while (true) {
+		ParseJob job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this] {
+				return _stopping || !_queue.empty();
+			});
+			if (_stopping)
+				return;
+			job = std::move(_queue.front());
+			_queue.pop_front();
+		}
+		_run(job, p);
+	}
+}
+
+void ParsePool::_run(ParseJob &job, ParseInfo &p) {
+	std::optional<std::string> error;
+	if (!job.cancelled->load()) {
+		try {
+			_parse(job, p);
+		} catch (const std::exception &parse_error) {
+			error = parse_error.what();
+		}
+	}
+
+	// only the tree is built with the GIL, from the nodes parsed without it
+	py::gil_scoped_acquire acquire;
+	if (!job.cancelled->load()) {
+		try {
+			if (error.has_value())
+				throw std::runtime_error(error.value());
+			_resolve(job, py::cast(build_root(p)), py::none());
+		} catch (py::error_already_set &build_error) {
+			_resolve(job, py::none(), build_error.value());
+		} catch (const std::exception &build_error) {
+			_resolve(job, py::none(), py::handle(PyExc_RuntimeError)(build_error.what()));
+		}
+	}
+	// built elements are released here too
+	p.reset();
+	p.trim(PARSE_POOL_MAX_RETAINED_BYTES);
+	job.future = py::object();
+	job.loop = py::object();
+}
+
+void ParsePool::_parse(ParseJob &job, ParseInfo &p) {
+	bool has_input = true;
+	if (job.is_file) {
+		std::ifstream file(job.source);
+		has_input = file.is_open();
+		job.source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	p.options = job.options;
+	p.reset();
+	if (job.options.expand_macros && has_input) {
+		p.expansion = MacroExpander(job.source, job.options.max_expansion_depth,
+				job.options.max_expansion_size, job.options.recover).expand();
+	}
+	const std::string &text = p.expansion.has_value() ? p.expansion->text : job.source;
+	p.contents.reserve(text.size() + 1);
+	for (size_t start = 0; start < text.size(); start += PARSE_POOL_CHUNK_SIZE) {
+		if (job.cancelled->load())
+			return;
+		size_t end = std::min(start + PARSE_POOL_CHUNK_SIZE, text.size());
+		for (size_t i = start; i < end; i++)
+			process_char(p, text[i]);
+	}
+	if (has_input)
+		process_char(p, EOF);
+	finish_parse(p);
+}
+
+void ParsePool::_resolve(ParseJob &job, py::object result, py::object exception) {
+	try {
+		job.loop.attr("call_soon_threadsafe")(py::cpp_function(
+				[](py::object future, py::object result, py::object exception) {
+					if (future.attr("done")().cast<bool>())
+						return;
+					if (exception.is_none())
+						future.attr("set_result")(result);
+					else
+						future.attr("set_exception")(exception);
+				}), job.future, result, exception);
+	} catch (py::error_already_set &) {
+		// the event loop was closed while parsing
+	}
+}
@@ -0,0 +1,50 @@
+#include "tex_columns.h"
+
+const std::vector<std::string> TEX_ELEMENT_TYPE_NAMES = {"TexElement", "TexCommand", "TexArg", "TexEnv",
+		"TexComment", "TexText", "TexRoot"};
+
+TexColumns::TexColumns(TexElement &element) {
+	type = std::make_shared<TexColumn<uint8_t>>();
+	name = std::make_shared<TexColumn<int32_t>>();
+	start_pos = std::make_shared<TexColumn<uint32_t>>();
+	end_pos = std::make_shared<TexColumn<uint32_t>>();
+	line = std::make_shared<TexColumn<uint16_t>>();
+	depth = std::make_shared<TexColumn<uint16_t>>();
+	parent = std::make_shared<TexColumn<int32_t>>();
+
+	_add_element(element, 0, -1);
+}
+
+int32_t TexColumns::_intern_name(const std::string &name) {
+	auto [it, inserted] = _name_indices.try_emplace(name, names.size());
+	if (inserted)
+		names.push_back(name);
+	return it->second;
+}
+
+void TexColumns::_add_element(TexElement &element, uint16_t depth, int32_t parent) {
+	int32_t index = type->size();
+	TexElementType element_type = get_element_type(element);
+
+	int32_t name_index = -1;
+	if (element_type == TexElementType::COMMAND)
+		name_index = _intern_name(static_cast<TexCommand &>(element).name);
+	else if (element_type == TexElementType::ENV)
+		name_index = _intern_name(static_cast<TexEnv &>(element).name);
+
+	type->values.push_back(static_cast<uint8_t>(element_type));
+	name->values.push_back(name_index);
+	start_pos->values.push_back(element.start_pos);
+	end_pos->values.push_back(element.end_pos);
+	line->values.push_back(element.start_line);
+	this->depth->values.push_back(depth);
+	this->parent->values.push_back(parent);
+
+	for (py::handle child: element.children)
+		_add_element(*py::cast<std::shared_ptr<TexElement>>(child), depth + 1, index);
+}
+
+std::shared_ptr<TexColumns> TexElement::to_columns() {
+	update_positions();
+	return std::make_shared<TexColumns>(*this);
+}
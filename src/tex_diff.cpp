@@ -0,0 +1,200 @@
+#include "tex_diff.h"
+
+static std::vector<std::shared_ptr<TexElement>> get_children(const TexElement &element) {
+	std::vector<std::shared_ptr<TexElement>> children;
+	children.reserve(element.children.size());
+	for (py::handle child: element.children)
+		children.push_back(py::cast<std::shared_ptr<TexElement>>(child));
+	return children;
+}
+
+std::string TexDiff::__repr__() const {
+	return "TexDiff(" + std::to_string(inserted.size()) + " inserted, " + std::to_string(deleted.size()) +
+			" deleted, " + std::to_string(modified.size()) + " modified)";
+}
+
+TexDiff TexDiffer::diff(const std::shared_ptr<TexElement> &a, const std::shared_ptr<TexElement> &b) {
+	_result = TexDiff();
+	a->update_hash();
+	b->update_hash();
+	if (!equal_subtrees(*a, *b)) {
+		if (_matches(*a, *b))
+			_diff_elements(a, b);
+		else {
+			_result.deleted.push_back(a);
+			_result.inserted.push_back(b);
+		}
+	}
+	return std::move(_result);
+}
+
+bool TexDiffer::_matches(const TexElement &a, const TexElement &b) {
+	TexElementType type = get_element_type(a);
+	if (type != get_element_type(b))
+		return false;
+	if (type == TexElementType::COMMAND)
+		return static_cast<const TexCommand &>(a).name == static_cast<const TexCommand &>(b).name;
+	if (type == TexElementType::ENV)
+		return static_cast<const TexEnv &>(a).name == static_cast<const TexEnv &>(b).name;
+	return true;
+}
+
+void TexDiffer::_diff_elements(const std::shared_ptr<TexElement> &a, const std::shared_ptr<TexElement> &b) {
+	// changes are reported on the innermost elements that differ, so a command is only modified if
+	// its own delimiters changed rather than its arguments
+	if (a->label_hash() != b->label_hash())
+		_result.modified.emplace_back(a, b);
+	if (!a->children.empty() || !b->children.empty())
+		_diff_children(*a, *b);
+}
+
+void TexDiffer::_diff_children(const TexElement &a, const TexElement &b) {
+	std::vector<std::shared_ptr<TexElement>> a_children = get_children(a);
+	std::vector<std::shared_ptr<TexElement>> b_children = get_children(b);
+
+	size_t size = std::min(a_children.size(), b_children.size());
+	size_t prefix = 0;
+	while (prefix < size && equal_subtrees(*a_children[prefix], *b_children[prefix]))
+		prefix++;
+	size_t suffix = 0;
+	while (suffix < size - prefix && equal_subtrees(*a_children[a_children.size() - 1 - suffix],
+			*b_children[b_children.size() - 1 - suffix]))
+		suffix++;
+
+	size_t a_end = a_children.size() - suffix;
+	size_t b_end = b_children.size() - suffix;
+	size_t a_size = a_end - prefix;
+	size_t b_size = b_end - prefix;
+	if (a_size == 0 || b_size == 0 || a_size * b_size > TEX_DIFF_MAX_LCS_CELLS) {
+		_align(a_children, prefix, a_end, b_children, prefix, b_end);
+		return;
+	}
+
+	// longest common subsequence of the remaining children by hash; identical children anchor the
+	// alignment and the runs between them are aligned by type and name. Children with equal hashes
+	// that turn out to differ are not used as anchors.
+	std::vector<uint32_t> lengths((a_size + 1) * (b_size + 1), 0);
+	auto length = [&](size_t i, size_t j) -> uint32_t & {
+		return lengths[i * (b_size + 1) + j];
+	};
+	for (size_t i = a_size; i-- > 0;)
+		for (size_t j = b_size; j-- > 0;)
+			length(i, j) = a_children[prefix + i]->_hash == b_children[prefix + j]->_hash ?
+					length(i + 1, j + 1) + 1 : std::max(length(i + 1, j), length(i, j + 1));
+
+	size_t i = 0, j = 0, run_i = 0, run_j = 0;
+	while (i < a_size && j < b_size) {
+		if (equal_subtrees(*a_children[prefix + i], *b_children[prefix + j])) {
+			_align(a_children, prefix + run_i, prefix + i, b_children, prefix + run_j, prefix + j);
+			run_i = ++i;
+			run_j = ++j;
+		} else if (length(i + 1, j) >= length(i, j + 1))
+			i++;
+		else
+			j++;
+	}
+	_align(a_children, prefix + run_i, a_end, b_children, prefix + run_j, b_end);
+}
+
+void TexDiffer::_align(const std::vector<std::shared_ptr<TexElement>> &a, size_t a_start, size_t a_end,
+		const std::vector<std::shared_ptr<TexElement>> &b, size_t b_start, size_t b_end) {
+	size_t j = b_start;
+	for (size_t i = a_start; i < a_end; i++) {
+		size_t k = j;
+		while (k < b_end && !_matches(*a[i], *b[k]))
+			k++;
+		if (k == b_end) {
+			_result.deleted.push_back(a[i]);
+			continue;
+		}
+		for (; j < k; j++)
+			_result.inserted.push_back(b[j]);
+		if (!equal_subtrees(*a[i], *b[k]))
+			_diff_elements(a[i], b[k]);
+		j = k + 1;
+	}
+	for (; j < b_end; j++)
+		_result.inserted.push_back(b[j]);
+}
+
+TexDiff diff(const std::shared_ptr<TexElement> &a, const std::shared_ptr<TexElement> &b) {
+	return TexDiffer().diff(a, b);
+}
+
+bool equal_subtrees(const TexElement &a, const TexElement &b) {
+	// only the top elements are compared, so that skipping identical subtrees takes constant time
+	TexElementType type = get_element_type(a);
+	if (a._hash != b._hash || type != get_element_type(b) || a.start_delimiter != b.start_delimiter ||
+			a.end_delimiter != b.end_delimiter || a.children.size() != b.children.size())
+		return false;
+	if (type == TexElementType::COMMAND &&
+			static_cast<const TexCommand &>(a).name != static_cast<const TexCommand &>(b).name)
+		return false;
+	if (type == TexElementType::ENV && static_cast<const TexEnv &>(a).name != static_cast<const TexEnv &>(b).name)
+		return false;
+	if (type == TexElementType::COMMENT &&
+			static_cast<const TexComment &>(a).text != static_cast<const TexComment &>(b).text)
+		return false;
+	if (type == TexElementType::TEXT &&
+			static_cast<const TexText &>(a).text != static_cast<const TexText &>(b).text)
+		return false;
+	return true;
+}
+
+struct TexHashCount {
+	uint32_t count = 0;
+	uint32_t nodes = 0;
+};
+
+static uint32_t count_hashes(const TexElement &element, std::unordered_map<uint64_t, TexHashCount> &counts) {
+	uint32_t nodes = 1;
+	for (py::handle child: element.children)
+		nodes += count_hashes(*py::cast<TexElement *>(child), counts);
+	TexHashCount &count = counts[element._hash];
+	count.count++;
+	count.nodes = nodes;
+	return nodes;
+}
+
+static void group_duplicates(const std::shared_ptr<TexElement> &element,
+		const std::unordered_map<uint64_t, TexHashCount> &counts, uint32_t min_nodes,
+		std::unordered_map<uint64_t, std::vector<size_t>> &group_indices,
+		std::vector<std::vector<std::shared_ptr<TexElement>>> &groups) {
+	const TexHashCount &count = counts.at(element->_hash);
+	if (count.count > 1 && count.nodes >= min_nodes) {
+		// the children of a duplicate are duplicates too, so only the outermost one is reported.
+		// Subtrees with colliding hashes but different top elements are put in separate groups.
+		std::vector<size_t> &indices = group_indices[element->_hash];
+		auto it = std::find_if(indices.begin(), indices.end(), [&](size_t index) {
+			return equal_subtrees(*groups[index].front(), *element);
+		});
+		if (it == indices.end()) {
+			it = indices.insert(indices.end(), groups.size());
+			groups.emplace_back();
+		}
+		groups[*it].push_back(element);
+		return;
+	}
+	for (py::handle child: element->children)
+		group_duplicates(py::cast<std::shared_ptr<TexElement>>(child), counts, min_nodes, group_indices,
+				groups);
+}
+
+std::vector<std::vector<std::shared_ptr<TexElement>>>
+find_duplicates(const std::vector<std::shared_ptr<TexElement>> &elements, uint32_t min_nodes) {
+	std::unordered_map<uint64_t, TexHashCount> counts;
+	for (const std::shared_ptr<TexElement> &element: elements) {
+		element->update_hash();
+		count_hashes(*element, counts);
+	}
+
+	std::unordered_map<uint64_t, std::vector<size_t>> group_indices;
+	std::vector<std::vector<std::shared_ptr<TexElement>>> groups;
+	for (const std::shared_ptr<TexElement> &element: elements)
+		group_duplicates(element, counts, min_nodes, group_indices, groups);
+
+	std::erase_if(groups, [](const std::vector<std::shared_ptr<TexElement>> &group) {
+		return group.size() < 2;
+	});
+	return groups;
+}
@@ -1,12 +1,21 @@
 #include "tex_element.h"
 
-const std::map<std::string, std::string> repr_replacements = {{"\n", "\\n"},
-															  {"\t", "\\t"}};
+const std::array<const char *, 256> TEX_REPR_ESCAPES = [] {
+	std::array<const char *, 256> escapes{};
+	escapes['\n'] = "\\n";
+	escapes['\t'] = "\\t";
+	return escapes;
+}();
 
-inline std::string reprfy_string(std::string string) {
-	for (auto const &[key, replacement]: repr_replacements)
-		string = std::regex_replace(string, std::regex(key), replacement);
-	return string;
+const std::map<std::string, uint8_t, std::less<>> TEX_SECTION_LEVELS = {
+		{"part", 0}, {"chapter", 1}, {"section", 2}, {"subsection", 3}, {"subsubsection", 4},
+		{"paragraph", 5}, {"subparagraph", 6}};
+
+inline std::string reprfy_string(std::string_view string) {
+	std::string out;
+	out.reserve(string.size());
+	append_escaped(out, string);
+	return out;
 }
 
 TexElement::TexElement(uint32_t start_pos, uint16_t start_line, uint32_t end_pos, uint16_t end_line,
@@ -36,42 +45,85 @@ TexElement::TexElement(std::optional<std::string> contents, py::list children) {
 				contents->size() - start_delimiter.size() - end_delimiter.size());
 }
 
-std::string TexElement::get_children_repr(uint8_t indent_level) {
-	std::string r;
-	for (py::handle child: children)
-		r += _get_indent(indent_level) +
-				py::cast<std::shared_ptr<TexElement>>(child)->repr(indent_level) + ",\n";
-	if (r.empty())
-		return r;
-	return "\n" + r + _get_indent(indent_level - 1);
+void TexElement::_write_children_repr(TexReprWriter &writer, uint8_t indent_level) {
+	if (children.empty())
+		return;
+	if (writer.depth >= writer.max_depth) {
+		writer.write("...");
+		return;
+	}
+	writer.write("\n");
+	writer.depth++;
+	for (py::handle child: children) {
+		if (writer.truncated)
+			break;
+		writer.write_indent(indent_level);
+		py::cast<TexElement *>(child)->write_repr(writer, indent_level);
+		writer.write(",\n");
+	}
+	writer.depth--;
+	writer.write_indent(indent_level - 1);
+}
+
+void TexElement::_write_default_repr(TexReprWriter &writer, std::string_view type_name,
+		uint8_t indent_level, std::string_view start_delimiter, std::string_view end_delimiter) {
+	writer.write(type_name);
+	writer.write("(");
+	writer.write(start_delimiter);
+	_write_children_repr(writer, indent_level + 1);
+	writer.write(end_delimiter);
+	writer.write(")");
 }
 
-std::string TexElement::_default_repr(std::string type_name, uint8_t indent_level,
-		std::optional<std::string> _start_delimiter, std::optional<std::string> _end_delimiter) {
-	return type_name + "(" + _start_delimiter.value_or(start_delimiter) +
-			get_children_repr(indent_level + 1) + _end_delimiter.value_or(end_delimiter) + ")";
+void TexElement::write_repr(TexReprWriter &writer, uint8_t indent_level) {
+	_write_default_repr(writer, "TexElement", indent_level, start_delimiter, end_delimiter);
 }
 
 std::string TexElement::repr(uint8_t indent_level) {
-	return _default_repr("TexElement", indent_level);
+	TexReprWriter writer;
+	write_repr(writer, indent_level);
+	return writer.finish();
+}
+
+std::string TexElement::repr_truncated(std::optional<size_t> max_depth, std::optional<size_t> max_length) {
+	TexReprWriter writer(max_depth.value_or(SIZE_MAX), max_length.value_or(SIZE_MAX));
+	write_repr(writer);
+	return writer.finish();
 }
 
 std::string TexElement::__repr__() {
 	return repr();
 }
 
-std::string TexElement::get_children_string() {
-	std::string str;
-	for (py::handle child: children) str += py::cast<std::shared_ptr<TexElement>>(child)->string();
-	return str;
+void TexElement::_write_children_string(std::string &out) {
+	for (py::handle child: children)
+		py::cast<TexElement *>(child)->write_string(out);
+}
+
+void TexElement::write_inner_string(std::string &out) {
+	_write_children_string(out);
+}
+
+void TexElement::write_string(std::string &out) {
+	out += start_delimiter;
+	write_inner_string(out);
+	out += end_delimiter;
 }
 
 std::string TexElement::inner_string() {
-	return get_children_string();
+	std::string out;
+	if (_inner_string.has_value())
+		out.reserve(_inner_string->size());
+	write_inner_string(out);
+	return out;
 }
 
 std::string TexElement::string() {
-	return start_delimiter + inner_string() + end_delimiter;
+	std::string out;
+	if (_string.has_value())
+		out.reserve(_string->size());
+	write_string(out);
+	return out;
 }
 
 template<typename T>
@@ -137,6 +189,234 @@ std::vector<std::shared_ptr<TexEnv>> TexElement::find_envs(std::string name) {
 	});
 }
 
+void TexElement::set_children(py::list children) {
+	// elements have a single parent, so ones that belong to another element must be removed first
+	for (py::handle handle: children) {
+		std::shared_ptr<TexElement> child = py::cast<std::shared_ptr<TexElement>>(handle);
+		if (child->parent.lock().get() != this)
+			_check_insertable(child);
+	}
+	for (py::handle child: this->children)
+		py::cast<TexElement *>(child)->parent.reset();
+	this->children = children;
+	adopt_children();
+	if (typeid(*this) == typeid(TexCommand))
+		static_cast<TexCommand *>(this)->_rebuild_args();
+	_invalidate();
+}
+
+void TexElement::adopt_children() {
+	std::shared_ptr<TexElement> self = shared_from_this();
+	for (py::handle handle: children) {
+		TexElement *child = py::cast<TexElement *>(handle);
+		std::shared_ptr<TexElement> parent = child->parent.lock();
+		if (parent && parent != self)
+			throw std::runtime_error("element already has a parent; remove it first");
+	}
+	uint32_t index = 0;
+	for (py::handle handle: children) {
+		TexElement *child = py::cast<TexElement *>(handle);
+		child->parent = self;
+		child->_index_in_parent = index++;
+	}
+}
+
+void TexElement::update_positions() {
+	std::shared_ptr<TexElement> top = shared_from_this();
+	for (std::shared_ptr<TexElement> parent = top->get_parent(); parent; parent = parent->get_parent())
+		top = parent;
+	// trees built from Python have no positions to recompute, and those of trees spanning files are
+	// relative to each element's file
+	if (!top->_positions_stale || top->start_pos == static_cast<uint32_t>(-1) || top->source_file)
+		return;
+	TexPositionCursor cursor{.pos = top->start_pos, .line = top->start_line};
+	top->_place(cursor);
+	if (typeid(*top) == typeid(TexRoot)) {
+		static_cast<TexRoot &>(*top).length = cursor.pos;
+		static_cast<TexRoot &>(*top).lines = cursor.line;
+	}
+	top->_positions_stale = false;
+}
+
+void TexElement::_place(TexPositionCursor &cursor) {
+	start_pos = cursor.pos;
+	start_line = cursor.line;
+	cursor.advance(start_delimiter);
+	TexElementType type = get_element_type(*this);
+	if (type == TexElementType::TEXT) {
+		cursor.advance(static_cast<TexText *>(this)->text);
+	} else if (type == TexElementType::COMMENT) {
+		cursor.advance(static_cast<TexComment *>(this)->text);
+	} else {
+		if (type == TexElementType::COMMAND)
+			static_cast<TexCommand *>(this)->_update_children();
+		for (py::handle child: children)
+			py::cast<TexElement *>(child)->_place(cursor);
+	}
+	cursor.advance(end_delimiter);
+	cursor.end(*this, type == TexElementType::TEXT);
+}
+
+std::pair<std::shared_ptr<TexElement>, size_t> TexElement::_locate() {
+	std::shared_ptr<TexElement> parent = this->parent.lock();
+	if (!parent)
+		throw std::runtime_error("element has no parent");
+	size_t index = parent->_find_child(this, _index_in_parent);
+	if (index == SIZE_MAX)
+		throw std::runtime_error("element is no longer a child of its parent");
+	_index_in_parent = index;
+	return {parent, index};
+}
+
+size_t TexElement::_find_child(const TexElement *child, size_t hint) const {
+	// edits move the following siblings by a few places, so the search starts where the child was
+	size_t size = children.size();
+	for (size_t distance = 0; distance <= hint || hint + distance < size; distance++) {
+		if (hint + distance < size && py::cast<TexElement *>(children[hint + distance]) == child)
+			return hint + distance;
+		if (distance > 0 && distance <= hint && hint - distance < size &&
+				py::cast<TexElement *>(children[hint - distance]) == child)
+			return hint - distance;
+	}
+	return SIZE_MAX;
+}
+
+void TexElement::_check_insertable(const std::shared_ptr<TexElement> &element) const {
+	if (!element->parent.expired())
+		throw std::runtime_error("element already has a parent; remove it first");
+	for (const TexElement *ancestor = this; ancestor; ancestor = ancestor->parent.lock().get())
+		if (ancestor == element.get())
+			throw std::runtime_error("cannot insert an element into its own descendant");
+}
+
+void TexElement::_splice_children(size_t start, size_t end,
+		const std::vector<std::shared_ptr<TexElement>> &elements, bool positions) {
+	for (size_t i = start; i < end; i++)
+		py::cast<TexElement *>(children[i])->parent.reset();
+	py::list replacement = py::cast(elements);
+	if (PyList_SetSlice(children.ptr(), start, end, replacement.ptr()) != 0)
+		throw py::error_already_set();
+
+	// the following siblings keep their old indices, which _locate corrects when they are edited
+	std::shared_ptr<TexElement> self = shared_from_this();
+	for (size_t i = 0; i < elements.size(); i++) {
+		elements[i]->parent = self;
+		elements[i]->_index_in_parent = start + i;
+	}
+
+	if (typeid(*this) == typeid(TexCommand))
+		static_cast<TexCommand *>(this)->_rebuild_args();
+	_invalidate(positions);
+}
+
+void TexElement::_invalidate(bool positions) {
+	std::shared_ptr<TexElement> element = shared_from_this();
+	while (true) {
+		element->_string.reset();
+		element->_inner_string.reset();
+		element->_hash_stale = true;
+		std::shared_ptr<TexElement> parent = element->get_parent();
+		if (!parent)
+			break;
+		element = parent;
+	}
+	if (positions)
+		element->_positions_stale = true;
+}
+
+uint64_t TexElement::label_hash() const {
+	TexElementType type = get_element_type(*this);
+	uint64_t hash = hash_combine(TEX_HASH_SEED, static_cast<uint64_t>(type));
+	hash = hash_combine(hash, hash_bytes(start_delimiter));
+	hash = hash_combine(hash, hash_bytes(end_delimiter));
+	if (type == TexElementType::COMMAND)
+		hash = hash_combine(hash, hash_bytes(static_cast<const TexCommand *>(this)->name));
+	else if (type == TexElementType::ENV)
+		hash = hash_combine(hash, hash_bytes(static_cast<const TexEnv *>(this)->name));
+	else if (type == TexElementType::COMMENT)
+		hash = hash_combine(hash, hash_bytes(static_cast<const TexComment *>(this)->text));
+	else if (type == TexElementType::TEXT)
+		hash = hash_combine(hash, hash_bytes(static_cast<const TexText *>(this)->text));
+	return hash;
+}
+
+uint64_t TexElement::update_hash() {
+	if (!_hash_stale)
+		return _hash;
+	uint64_t hash = label_hash();
+	// children put in the list in place are not linked to this element, so editing them would not
+	// mark its hash stale, and it is only kept while there are none
+	bool stale = false;
+	for (py::handle handle: children) {
+		TexElement *child = py::cast<TexElement *>(handle);
+		hash = hash_combine(hash, child->update_hash());
+		stale = stale || child->_hash_stale || child->parent.lock().get() != this;
+	}
+	_hash = hash;
+	_hash_stale = stale;
+	return hash;
+}
+
+void TexElement::_invalidate_hash() {
+	// the ancestors of an element with a stale hash are stale too
+	std::shared_ptr<TexElement> element = shared_from_this();
+	while (element && !element->_hash_stale) {
+		element->_hash_stale = true;
+		element = element->get_parent();
+	}
+}
+
+void TexElement::set_start_delimiter(std::string start_delimiter) {
+	this->start_delimiter = start_delimiter;
+	_invalidate();
+}
+
+void TexElement::set_end_delimiter(std::string end_delimiter) {
+	this->end_delimiter = end_delimiter;
+	_invalidate();
+}
+
+void TexElement::replace_with(std::shared_ptr<TexElement> element) {
+	auto [parent, index] = _locate();
+	parent->_check_insertable(element);
+	parent->_splice_children(index, index + 1, {element});
+}
+
+void TexElement::remove() {
+	auto [parent, index] = _locate();
+	parent->_splice_children(index, index + 1, {});
+}
+
+void TexElement::insert_before(std::shared_ptr<TexElement> element) {
+	auto [parent, index] = _locate();
+	parent->_check_insertable(element);
+	parent->_splice_children(index, index, {element});
+}
+
+void TexElement::insert_after(std::shared_ptr<TexElement> element) {
+	auto [parent, index] = _locate();
+	parent->_check_insertable(element);
+	parent->_splice_children(index + 1, index + 1, {element});
+}
+
+void TexElement::unwrap() {
+	auto [parent, index] = _locate();
+	std::vector<std::shared_ptr<TexElement>> elements;
+	bool is_command = typeid(*this) == typeid(TexCommand);
+	for (py::handle handle: children) {
+		std::shared_ptr<TexElement> child = py::cast<std::shared_ptr<TexElement>>(handle);
+		// commands are replaced by the contents of their arguments
+		if (is_command && typeid(*child) == typeid(TexArg)) {
+			for (py::handle arg_child: child->children)
+				elements.push_back(py::cast<std::shared_ptr<TexElement>>(arg_child));
+			child->set_children(py::list());
+		} else
+			elements.push_back(child);
+	}
+	set_children(py::list());
+	parent->_splice_children(index, index + 1, elements);
+}
+
 TexCommand::TexCommand(uint32_t start_pos, uint16_t start_line, uint32_t end_pos, uint16_t end_line,
 		std::string start_delimiter, std::string end_delimiter, std::string contents,
 		std::vector<std::shared_ptr<TexElement>> children, std::string name) : TexElement(start_pos,
@@ -174,28 +454,69 @@ bool TexCommand::_args_has_changes() {
 
 bool TexCommand::_update_children() {
 	if (_args_has_changes()) {
+		for (py::handle child: children)
+			py::cast<TexElement *>(child)->parent.reset();
 		children = args;
+		adopt_children();
+		_invalidate();
 		return true;
 	}
 	return false;
 }
 
-std::string TexCommand::inner_string() {
-	if (_update_children()) {
-		return _args_string;
-	} else if (_inner_string.has_value())
-		return _inner_string.value();
-	return get_children_string();
+void TexCommand::set_args(py::list args) {
+	for (py::handle arg: args)
+		if (typeid(*py::cast<TexElement *>(arg)) != typeid(TexArg))
+			throw std::runtime_error("command arguments must be TexArg elements");
+	set_children(args);
+}
+
+void TexCommand::_rebuild_args() {
+	args = py::list();
+	for (py::handle child: children)
+		if (typeid(*py::cast<std::shared_ptr<TexElement>>(child)) == typeid(TexArg))
+			args.append(child);
+	_args_has_changes();
+}
+
+std::shared_ptr<TexArg> TexCommand::last_mandatory_arg() {
+	for (size_t i = args.size(); i-- > 0;) {
+		std::shared_ptr<TexArg> arg = py::cast<std::shared_ptr<TexArg>>(args[i]);
+		if (arg->start_delimiter == "{")
+			return arg;
+	}
+	return nullptr;
+}
+
+std::string TexCommand::last_mandatory_arg_text() {
+	std::shared_ptr<TexArg> arg = last_mandatory_arg();
+	if (!arg)
+		return "";
+	return arg->_inner_string.has_value() ? arg->_inner_string.value() : arg->inner_string();
 }
 
-std::string TexCommand::repr(uint8_t indent_level) {
+void TexCommand::write_inner_string(std::string &out) {
+	if (_update_children())
+		out += _args_string;
+	else if (_inner_string.has_value())
+		out += _inner_string.value();
+	else
+		_write_children_string(out);
+}
+
+void TexCommand::write_repr(TexReprWriter &writer, uint8_t indent_level) {
 	_update_children();
-	return _default_repr("TexCommand", indent_level, name + ": ", "");
+	writer.write("TexCommand(");
+	writer.write(name);
+	writer.write(": ");
+	_write_children_repr(writer, indent_level + 1);
+	writer.write(")");
 }
 
 void TexCommand::set_name(std::string name) {
 	this->name = name;
 	start_delimiter = "\\" + name;
+	_invalidate();
 }
 
 TexArg::TexArg(uint32_t start_pos, uint16_t start_line, uint32_t end_pos, uint16_t end_line,
@@ -210,8 +531,8 @@ TexArg::TexArg(std::string start_delimiter, std::string end_delimiter, py::list
 	this->end_delimiter = end_delimiter;
 }
 
-std::string TexArg::repr(uint8_t indent_level) {
-	return _default_repr("TexArg", indent_level);
+void TexArg::write_repr(TexReprWriter &writer, uint8_t indent_level) {
+	_write_default_repr(writer, "TexArg", indent_level, start_delimiter, end_delimiter);
 }
 
 TexEnv::TexEnv(uint32_t start_pos, uint16_t start_line, uint32_t end_pos, uint16_t end_line,
@@ -227,14 +548,19 @@ TexEnv::TexEnv(std::string name, py::list children) : TexElement({}, children) {
 	end_delimiter = "\\end{" + name + "}";
 }
 
-std::string TexEnv::repr(uint8_t indent_level) {
-	return _default_repr("TexEnv", indent_level, name + ": ", "");
+void TexEnv::write_repr(TexReprWriter &writer, uint8_t indent_level) {
+	writer.write("TexEnv(");
+	writer.write(name);
+	writer.write(": ");
+	_write_children_repr(writer, indent_level + 1);
+	writer.write(")");
 }
 
 void TexEnv::set_name(std::string name) {
 	this->name = name;
 	start_delimiter = "\\begin{" + name + "}";
 	end_delimiter = "\\end{" + name + "}";
+	_invalidate();
 }
 
 TexComment::TexComment(uint32_t start_pos, uint16_t start_line, uint32_t end_pos, uint16_t end_line,
@@ -250,12 +576,19 @@ TexComment::TexComment(std::string text) : TexElement("%" + text + "\n") {
 	end_delimiter = "\n";
 }
 
-std::string TexComment::repr(uint8_t indent_level) {
-	return "TexComment(" + reprfy_string(text) + ")";
+void TexComment::write_repr(TexReprWriter &writer, uint8_t indent_level) {
+	writer.write("TexComment(");
+	writer.write_escaped(text);
+	writer.write(")");
+}
+
+void TexComment::write_inner_string(std::string &out) {
+	out += text;
 }
 
-std::string TexComment::inner_string() {
-	return text;
+void TexComment::set_text(std::string text) {
+	this->text = text;
+	_invalidate();
 }
 
 TexText::TexText(uint32_t start_pos, uint16_t start_line, uint32_t end_pos, uint16_t end_line,
@@ -268,12 +601,19 @@ TexText::TexText(std::string text) : TexElement(text) {
 	this->text = text;
 }
 
-std::string TexText::repr(uint8_t indent_level) {
-	return "t'" + reprfy_string(text) + "'";
+void TexText::write_repr(TexReprWriter &writer, uint8_t indent_level) {
+	writer.write("t'");
+	writer.write_escaped(text);
+	writer.write("'");
 }
 
-std::string TexText::inner_string() {
-	return text;
+void TexText::write_inner_string(std::string &out) {
+	out += text;
+}
+
+void TexText::set_text(std::string text) {
+	this->text = text;
+	_invalidate();
 }
 
 TexRoot::TexRoot(uint32_t length, uint16_t lines, std::string contents,
@@ -286,6 +626,15 @@ TexRoot::TexRoot(uint32_t length, uint16_t lines, std::string contents,
 TexRoot::TexRoot(py::list children) : TexElement({}, children) {
 }
 
-std::string TexRoot::repr(uint8_t indent_level) {
-	return _default_repr("TexRoot", indent_level);
-}
\ No newline at end of file
+void TexRoot::write_repr(TexReprWriter &writer, uint8_t indent_level) {
+	_write_default_repr(writer, "TexRoot", indent_level, start_delimiter, end_delimiter);
+}
+
+std::string TexDiagnostic::__repr__() const {
+	return "TexDiagnostic(line " + std::to_string(line) + ", pos " + std::to_string(pos) + ": " +
+			reprfy_string(message) + ")";
+}
+
+std::string TexMacro::__repr__() const {
+	return "TexMacro(\\" + name + "[" + std::to_string(num_args) + "]: " + reprfy_string(body) + ")";
+}
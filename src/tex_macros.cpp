@@ -0,0 +1,346 @@
+#include "tex_macros.h"
+#include "tex_project.h"
+
+static const std::unordered_map<std::string_view, bool> MACRO_DEFINITION_COMMANDS = {
+		{"newcommand",          false},
+		{"renewcommand",        false},
+		{"providecommand",      false},
+		{"DeclareMathOperator", false},
+		{"def",                 true},
+		{"gdef",                true},
+		{"edef",                true},
+		{"xdef",                true}};
+
+inline bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+uint16_t TexMacroExpansion::get_line(uint32_t pos) const {
+	return std::upper_bound(line_starts.begin(), line_starts.end(), pos) - line_starts.begin() - 1;
+}
+
+uint32_t TexMacroExpansion::map_end_pos(uint32_t pos) const {
+	const TexMacroUse *use = _find_use(pos);
+	return use != nullptr ? use->source_end - 1 : map_pos(pos);
+}
+
+const TexMacroUse *TexMacroExpansion::_find_use(uint32_t pos) const {
+	auto it = std::upper_bound(uses.begin(), uses.end(), pos, [](uint32_t pos, const TexMacroUse &use) {
+		return pos < use.start;
+	});
+	if (it == uses.begin() || pos >= std::prev(it)->end)
+		return nullptr;
+	return &*std::prev(it);
+}
+
+bool TexMacroExpansion::_overlaps_use(uint32_t start, uint32_t end) const {
+	auto it = std::partition_point(uses.begin(), uses.end(), [start](const TexMacroUse &use) {
+		return use.end <= start;
+	});
+	return it != uses.end() && it->start < end;
+}
+
+void TexMacroExpansion::_remap(TexElement &element) const {
+	// text ends are exclusive and those of other elements inclusive; an element that ends inside
+	// the text of a macro use ends with the use
+	bool exclusive = typeid(element) == typeid(TexText);
+	uint32_t start = element.start_pos;
+	uint32_t end = exclusive ? element.end_pos : element.end_pos + 1;
+	element.from_macro = _overlaps_use(start, end);
+	element.start_pos = map_pos(start);
+	element.start_line = get_line(element.start_pos);
+	element.end_pos = end > start ? map_end_pos(end - 1) + exclusive : map_pos(element.end_pos);
+	element.end_line = get_line(element.end_pos);
+	for (py::handle child: element.children)
+		_remap(*py::cast<std::shared_ptr<TexElement>>(child));
+}
+
+void TexMacroExpansion::apply(TexRoot &root) const {
+	for (py::handle child: root.children)
+		_remap(*py::cast<std::shared_ptr<TexElement>>(child));
+	root.from_macro = !uses.empty();
+	root.length = map_pos(root.length);
+	root.lines = get_line(source_size);
+	// like the parser, the root ends on its last character
+	root.end_pos = root.length > 0 ? root.length - 1 : 0;
+	root.end_line = get_line(root.end_pos);
+	for (TexDiagnostic &diagnostic: root.diagnostics) {
+		diagnostic.pos = map_pos(diagnostic.pos);
+		diagnostic.line = get_line(diagnostic.pos);
+	}
+	root.diagnostics.insert(root.diagnostics.end(), diagnostics.begin(), diagnostics.end());
+	root.macros.insert(macros.begin(), macros.end());
+}
+
+MacroExpander::MacroExpander(std::string_view source, size_t max_depth, size_t max_size, bool recover,
+		std::map<std::string, TexMacro, std::less<>> macros) : source(source), max_depth(max_depth),
+		max_size(max_size), recover(recover) {
+	_expansion.macros = std::move(macros);
+}
+
+TexMacroExpansion MacroExpander::expand() {
+	_expansion.source_size = source.size();
+	_expansion.line_starts.push_back(0);
+	for (size_t i = 0; i < source.size(); i++)
+		if (source[i] == '\n')
+			_expansion.line_starts.push_back(i + 1);
+
+	_expansion.text.reserve(source.size());
+	_expansion.offsets.reserve(source.size());
+	_expand(source, 0, {}, _expansion.text, &_expansion.offsets);
+	return std::move(_expansion);
+}
+
+void MacroExpander::_expand(std::string_view text, size_t depth, std::optional<uint32_t> use_pos,
+		std::string &out, std::vector<uint32_t> *offsets) {
+	TexScanner scanner(text);
+	size_t copied = 0;
+	auto copy_until = [&](size_t end) {
+		out.append(text.substr(copied, end - copied));
+		if (offsets != nullptr)
+			for (size_t k = copied; k < end; k++)
+				offsets->push_back(use_pos.value_or(k));
+		copied = end;
+	};
+
+	size_t i = 0;
+	while (i < text.size()) {
+		char c = text[i];
+		if (c == '%') {
+			i = scanner.skip_comment(i);
+			continue;
+		}
+		if (c != '\\') {
+			if (c == '{')
+				_group_depth++;
+			else if (c == '}' && _group_depth > 0)
+				_group_depth--;
+			i++;
+			continue;
+		}
+		size_t name_end = scanner.read_command_name(i);
+		if (name_end == i + 1) {
+			i = std::min(i + 2, text.size());
+			continue;
+		}
+		std::string_view name = text.substr(i + 1, name_end - i - 1);
+
+		// like parse_project, only inclusions outside arguments include anything
+		if (on_include && _group_depth == 0 && TEX_PROJECT_INCLUDE_COMMANDS.contains(name)) {
+			std::optional<TexScannedArg> arg = scanner.next_arg(name_end);
+			if (arg.has_value() && arg->start_delimiter == '{' && arg->closed) {
+				on_include(name, scanner.arg_text(*arg), _expansion.macros);
+				_memo.clear();
+			}
+			i = name_end;
+			continue;
+		}
+
+		// definitions are kept as they are, without expanding their bodies
+		if (MACRO_DEFINITION_COMMANDS.contains(name)) {
+			i = _read_definition(scanner, i, name, name_end, use_pos.value_or(i));
+			continue;
+		}
+
+		auto macro = _expansion.macros.find(name);
+		size_t args_end = name_end;
+		std::vector<std::string> args;
+		if (macro == _expansion.macros.end() || !_read_use_args(scanner, macro->second, args_end, args)) {
+			i = name_end;
+			continue;
+		}
+
+		uint32_t pos = use_pos.value_or(i);
+		std::string expanded;
+		try {
+			expanded = _expand_use(macro->second, args, depth, pos);
+		} catch (const std::runtime_error &error) {
+			if (!recover || depth > 0)
+				throw;
+			_expansion.diagnostics.push_back(TexDiagnostic{.message = error.what(), .pos = pos,
+					.line = _expansion.get_line(pos)});
+			i = args_end;
+			continue;
+		}
+		copy_until(i);
+		if (out.size() + expanded.size() > max_size) {
+			std::string message = "macro expansion exceeded the maximum size of " + std::to_string(max_size) +
+					" characters";
+			if (!recover || depth > 0)
+				throw std::runtime_error(message);
+			// the rest of the source is kept as it is, from this use on
+			_expansion.diagnostics.push_back(TexDiagnostic{.message = message, .pos = pos,
+					.line = _expansion.get_line(pos)});
+			break;
+		}
+		if (offsets != nullptr) {
+			if (!expanded.empty())
+				_expansion.uses.push_back(TexMacroUse{.start = static_cast<uint32_t>(out.size()),
+						.end = static_cast<uint32_t>(out.size() + expanded.size()),
+						.source_end = static_cast<uint32_t>(args_end)});
+			offsets->insert(offsets->end(), expanded.size(), pos);
+		}
+		out += expanded;
+		copied = i = args_end;
+	}
+	copy_until(text.size());
+}
+
+size_t MacroExpander::_read_definition(const TexScanner &scanner, size_t i, std::string_view command,
+		size_t name_end, uint32_t pos) {
+	std::string_view text = scanner.source;
+	size_t end = name_end;
+	bool starred = end < text.size() && text[end] == '*';
+	if (starred)
+		end++;
+	while (end < text.size() && text[end] == ' ')
+		end++;
+
+	TexMacro macro{.num_args = 0, .pos = pos};
+	if (end < text.size() && text[end] == '{') {
+		bool closed;
+		size_t group_end = scanner.find_group_end(end, &closed);
+		std::string_view group = text.substr(end + 1, group_end - end - 2);
+		while (!group.empty() && is_space(group.front()))
+			group.remove_prefix(1);
+		while (!group.empty() && is_space(group.back()))
+			group.remove_suffix(1);
+		if (!closed || group.size() < 2 || group[0] != '\\')
+			return name_end;
+		macro.name = group.substr(1);
+		end = group_end;
+	} else if (end < text.size() && text[end] == '\\') {
+		size_t macro_name_end = scanner.read_command_name(end);
+		macro.name = text.substr(end + 1, macro_name_end - end - 1);
+		end = macro_name_end;
+	} else
+		return name_end;
+
+	if (MACRO_DEFINITION_COMMANDS.at(command)) {
+		// like TeX, spaces after the macro name are skipped
+		while (end < text.size() && is_space(text[end]))
+			end++;
+		while (end + 1 < text.size() && text[end] == '#' && text[end + 1] == '1' + macro.num_args) {
+			macro.num_args++;
+			end += 2;
+		}
+		// delimited parameters are not supported
+		if (end >= text.size() || text[end] != '{')
+			return name_end;
+	} else if (command != "DeclareMathOperator") {
+		std::optional<TexScannedArg> arg = scanner.next_arg(end);
+		if (arg.has_value() && arg->start_delimiter == '[') {
+			std::string_view num_args = scanner.arg_text(*arg);
+			if (num_args.size() != 1 || num_args[0] < '0' || num_args[0] > '9')
+				return name_end;
+			macro.num_args = num_args[0] - '0';
+			end = arg->end;
+			arg = scanner.next_arg(end);
+			if (arg.has_value() && arg->start_delimiter == '[') {
+				macro.default_arg = scanner.arg_text(*arg);
+				end = arg->end;
+			}
+		}
+	}
+
+	std::optional<TexScannedArg> body = scanner.next_arg(end);
+	if (!body.has_value() || body->start_delimiter != '{' || !body->closed)
+		return name_end;
+	if (command == "DeclareMathOperator")
+		macro.body = std::string("\\operatorname") + (starred ? "*" : "") + "{" +
+				std::string(scanner.arg_text(*body)) + "}";
+	else
+		macro.body = scanner.arg_text(*body);
+	if (macro.default_arg.has_value() && macro.num_args == 0)
+		macro.default_arg.reset();
+
+	if (command != "providecommand" || !_expansion.macros.contains(macro.name)) {
+		_expansion.macros.insert_or_assign(macro.name, macro);
+		_memo.clear();
+	}
+	return body->end;
+}
+
+bool MacroExpander::_read_use_args(const TexScanner &scanner, const TexMacro &macro, size_t &i,
+		std::vector<std::string> &args) const {
+	std::string_view text = scanner.source;
+	uint8_t num_args = macro.num_args;
+	if (macro.default_arg.has_value()) {
+		std::optional<TexScannedArg> arg = scanner.next_arg(i);
+		if (arg.has_value() && arg->start_delimiter == '[' && arg->closed) {
+			args.emplace_back(scanner.arg_text(*arg));
+			i = arg->end;
+		} else
+			args.push_back(macro.default_arg.value());
+		num_args--;
+	}
+
+	if (num_args == 0) {
+		// an empty group after a macro without arguments (eg. \LaTeX{}) belongs to it
+		if (i + 1 < text.size() && text[i] == '{' && text[i + 1] == '}')
+			i += 2;
+		return true;
+	}
+
+	for (uint8_t k = 0; k < num_args; k++) {
+		while (i < text.size() && is_space(text[i]))
+			i++;
+		if (i >= text.size() || text[i] == '}' || text[i] == '%')
+			return false;
+		if (text[i] == '{') {
+			bool closed;
+			size_t group_end = scanner.find_group_end(i, &closed);
+			if (!closed)
+				return false;
+			args.emplace_back(text.substr(i + 1, group_end - i - 2));
+			i = group_end;
+		} else if (text[i] == '\\') {
+			size_t token_end = std::max(scanner.read_command_name(i), std::min(i + 2, text.size()));
+			args.emplace_back(text.substr(i, token_end - i));
+			i = token_end;
+		} else {
+			args.emplace_back(1, text[i]);
+			i++;
+		}
+	}
+	return true;
+}
+
+std::string MacroExpander::_expand_use(const TexMacro &macro, const std::vector<std::string> &args,
+		size_t depth, uint32_t pos) {
+	if (depth >= max_depth)
+		throw std::runtime_error("macro expansion of \\" + macro.name + " exceeded the maximum depth of " +
+				std::to_string(max_depth));
+
+	std::string key = std::to_string(depth) + '\0' + macro.name;
+	for (const std::string &arg: args) {
+		key += '\0';
+		key += arg;
+	}
+	auto memo = _memo.find(key);
+	if (memo != _memo.end())
+		return memo->second;
+
+	std::string substituted;
+	const std::string &body = macro.body;
+	for (size_t i = 0; i < body.size(); i++) {
+		if (body[i] == '#' && i + 1 < body.size()) {
+			char next = body[i + 1];
+			if (next == '#') {
+				substituted += '#';
+				i++;
+				continue;
+			} else if (next >= '1' && next < '1' + static_cast<char>(args.size())) {
+				substituted += args[next - '1'];
+				i++;
+				continue;
+			}
+		}
+		substituted += body[i];
+	}
+
+	std::string expanded;
+	_expand(substituted, depth + 1, pos, expanded, nullptr);
+	_memo.emplace(std::move(key), expanded);
+	return expanded;
+}
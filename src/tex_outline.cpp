@@ -0,0 +1,125 @@
+#include "tex_outline.h"
+
+size_t TexChildrenView::_find_bound(TexElement &child) const {
+	size_t index = element->_find_child(&child, child._index_in_parent);
+	if (index == SIZE_MAX)
+		throw std::runtime_error("an element bounding the view was removed from its parent");
+	child._index_in_parent = index;
+	return index;
+}
+
+size_t TexChildrenView::start() const {
+	return after ? _find_bound(*after) + 1 : 0;
+}
+
+size_t TexChildrenView::end() const {
+	return before ? _find_bound(*before) : element->children.size();
+}
+
+std::shared_ptr<TexElement> TexChildrenView::get(int64_t index) const {
+	size_t start = this->start();
+	int64_t size = this->size();
+	if (index < 0)
+		index += size;
+	if (index < 0 || index >= size)
+		throw std::out_of_range("section content index out of range");
+	return py::cast<std::shared_ptr<TexElement>>(element->children[start + index]);
+}
+
+py::list TexChildrenView::to_list() const {
+	size_t start = this->start();
+	size_t size = this->size();
+	py::list list;
+	for (size_t i = 0; i < size; i++)
+		list.append(element->children[start + i]);
+	return list;
+}
+
+std::string TexChildrenView::string() const {
+	size_t start = this->start();
+	size_t size = this->size();
+	std::string out;
+	for (size_t i = 0; i < size; i++)
+		py::cast<TexElement *>(element->children[start + i])->write_string(out);
+	return out;
+}
+
+std::string TexChildrenView::__repr__() const {
+	return "TexChildrenView(" + std::to_string(size()) + " elements)";
+}
+
+std::string TexSection::__repr__() const {
+	std::string r = "TexSection(\\" + command->name + ": ";
+	append_escaped(r, title);
+	return r + ")";
+}
+
+static void close_section(TexSection &section, const std::shared_ptr<TexCommand> &next) {
+	const std::shared_ptr<TexElement> &container = section.content.element;
+	// the section ends at the child of its container holding the next heading, if there is one
+	if (next) {
+		std::shared_ptr<TexElement> element = next;
+		for (std::shared_ptr<TexElement> parent = element->get_parent(); parent;
+				element = parent, parent = parent->get_parent()) {
+			if (parent == container) {
+				section.content.before = element;
+				break;
+			}
+		}
+	}
+
+	size_t end = section.content.end();
+	if (end <= section.content.start()) {
+		section.end_pos = section.command->end_pos + 1;
+		section.end_line = section.command->end_line;
+	} else {
+		// text ends are exclusive and those of other elements inclusive
+		TexElement &last = *py::cast<TexElement *>(container->children[end - 1]);
+		section.end_pos = typeid(last) == typeid(TexText) ? last.end_pos : last.end_pos + 1;
+		section.end_line = last.end_line;
+	}
+}
+
+std::shared_ptr<TexOutline> build_outline(const std::vector<std::shared_ptr<TexCommand>> &commands) {
+	std::shared_ptr<TexOutline> outline = std::make_shared<TexOutline>();
+	std::vector<std::shared_ptr<TexSection>> open_sections;
+	for (const std::shared_ptr<TexCommand> &command: commands) {
+		// headings in arguments, such as in a \newcommand body, do not start sections
+		std::shared_ptr<TexElement> container = command->get_parent();
+		if (!container || typeid(*container) == typeid(TexArg))
+			continue;
+		std::shared_ptr<TexSection> section = std::make_shared<TexSection>();
+		section->command = command;
+		section->level = TEX_SECTION_LEVELS.at(command->name);
+		section->title = command->last_mandatory_arg_text();
+		section->start_pos = command->start_pos;
+		section->start_line = command->start_line;
+		section->content.element = container;
+		section->content.after = command;
+
+		while (!open_sections.empty() && open_sections.back()->level >= section->level) {
+			close_section(*open_sections.back(), command);
+			open_sections.pop_back();
+		}
+		if (open_sections.empty())
+			outline->sections.push_back(section);
+		else
+			open_sections.back()->subsections.push_back(section);
+		open_sections.push_back(section);
+		outline->all_sections.push_back(section);
+	}
+	for (const std::shared_ptr<TexSection> &section: open_sections)
+		close_section(*section, nullptr);
+	return outline;
+}
+
+void find_section_commands(TexElement &element, std::vector<std::shared_ptr<TexCommand>> &commands) {
+	for (py::handle handle: element.children) {
+		std::shared_ptr<TexElement> child = py::cast<std::shared_ptr<TexElement>>(handle);
+		if (typeid(*child) == typeid(TexCommand) &&
+				TEX_SECTION_LEVELS.contains(static_cast<TexCommand &>(*child).name))
+			commands.push_back(std::static_pointer_cast<TexCommand>(child));
+		else
+			find_section_commands(*child, commands);
+	}
+}
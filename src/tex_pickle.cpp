@@ -0,0 +1,419 @@
+#include "tex_pickle.h"
+
+uint32_t TexTreeEncoder::_intern(const std::string &string) {
+	auto [it, inserted] = _string_indices.try_emplace(string, _strings.size());
+	if (inserted)
+		_strings.push_back(&string);
+	return it->second;
+}
+
+void TexTreeEncoder::_write_cached_string(const std::optional<std::string> &cached,
+		const TexElement &element, const std::string *text, bool inner) {
+	if (!cached.has_value()) {
+		_write(_nodes, TexCachedString::NONE);
+	} else if (text != nullptr && *cached == *text) {
+		_write(_nodes, TexCachedString::TEXT);
+	} else if (inner && element._string.has_value() &&
+			element._string->size() >= element.start_delimiter.size() + element.end_delimiter.size() &&
+			std::string_view(*element._string).substr(element.start_delimiter.size(),
+					element._string->size() - element.start_delimiter.size() -
+							element.end_delimiter.size()) == *cached) {
+		_write(_nodes, TexCachedString::DERIVED);
+	} else if (!inner && !element.from_macro && element.start_pos >= _source_start &&
+			element.start_pos - _source_start <= _source.size() &&
+			_source.substr(element.start_pos - _source_start, cached->size()) == *cached) {
+		_write(_nodes, TexCachedString::SOURCE);
+		_write<uint32_t>(_nodes, element.start_pos - _source_start);
+		_write<uint32_t>(_nodes, cached->size());
+	} else {
+		_write(_nodes, TexCachedString::TABLE);
+		_write(_nodes, _intern(*cached));
+	}
+}
+
+void TexTreeEncoder::_write_element(TexElement &element) {
+	if (_index_nodes)
+		_node_indices.emplace(&element, _node_indices.size());
+	TexElementType type = get_element_type(element);
+	_write(_nodes, type);
+	_write(_nodes, element.start_pos);
+	_write(_nodes, element.start_line);
+	_write(_nodes, element.end_pos);
+	_write(_nodes, element.end_line);
+	_write(_nodes, _intern(element.start_delimiter));
+	_write(_nodes, _intern(element.end_delimiter));
+	_write(_nodes, element.source_file ? _intern(*element.source_file) : TEX_PICKLE_NO_INDEX);
+	_write<uint8_t>(_nodes, element.from_macro);
+
+	const std::string *text = nullptr;
+	if (type == TexElementType::COMMAND)
+		_write(_nodes, _intern(static_cast<TexCommand &>(element).name));
+	else if (type == TexElementType::ENV)
+		_write(_nodes, _intern(static_cast<TexEnv &>(element).name));
+	else if (type == TexElementType::COMMENT)
+		text = &static_cast<TexComment &>(element).text;
+	else if (type == TexElementType::TEXT)
+		text = &static_cast<TexText &>(element).text;
+	if (text != nullptr)
+		_write(_nodes, _intern(*text));
+
+	_write_cached_string(element._string, element, text, false);
+	_write_cached_string(element._inner_string, element, text, true);
+
+	_write<uint32_t>(_nodes, element.children.size());
+	for (py::handle child: element.children)
+		_write_element(*py::cast<std::shared_ptr<TexElement>>(child));
+
+	if (type == TexElementType::COMMAND) {
+		TexCommand &command = static_cast<TexCommand &>(element);
+		_write<uint32_t>(_nodes, command.args.size());
+		size_t args_string_pos = 0;
+		bool args_string_derived = true;
+		for (py::handle arg: command.args) {
+			uint32_t index = 0;
+			for (py::handle child: command.children) {
+				if (child.ptr() == arg.ptr())
+					break;
+				index++;
+			}
+			if (index < command.children.size()) {
+				_write(_nodes, index);
+			} else {
+				_write(_nodes, TEX_PICKLE_NO_INDEX);
+				_write_element(*py::cast<std::shared_ptr<TexElement>>(arg));
+			}
+
+			const std::optional<std::string> &arg_string = py::cast<std::shared_ptr<TexElement>>(
+					arg)->_string;
+			if (args_string_derived && arg_string.has_value() &&
+					std::string_view(command._args_string).substr(args_string_pos, arg_string->size()) ==
+							*arg_string)
+				args_string_pos += arg_string->size();
+			else
+				args_string_derived = false;
+		}
+		if (args_string_derived && args_string_pos == command._args_string.size()) {
+			_write(_nodes, TexCachedString::DERIVED);
+		} else {
+			_write(_nodes, TexCachedString::TABLE);
+			_write(_nodes, _intern(command._args_string));
+		}
+	} else if (type == TexElementType::ROOT) {
+		TexRoot &root = static_cast<TexRoot &>(element);
+		_write(_nodes, root.length);
+		_write(_nodes, root.lines);
+		_write<uint32_t>(_nodes, root.diagnostics.size());
+		for (const TexDiagnostic &diagnostic: root.diagnostics) {
+			_write(_nodes, _intern(diagnostic.message));
+			_write(_nodes, diagnostic.pos);
+			_write(_nodes, diagnostic.line);
+		}
+		_write<uint32_t>(_nodes, root.macros.size());
+		for (const auto &[name, macro]: root.macros) {
+			_write(_nodes, _intern(macro.name));
+			_write(_nodes, macro.num_args);
+			_write<uint8_t>(_nodes, macro.default_arg.has_value());
+			if (macro.default_arg.has_value())
+				_write(_nodes, _intern(*macro.default_arg));
+			_write(_nodes, _intern(macro.body));
+			_write(_nodes, macro.pos);
+		}
+		_write<uint8_t>(_nodes, root.xrefs != nullptr);
+		if (root.xrefs)
+			_write_xrefs(*root.xrefs);
+		// only the headings are stored, and the outline is rebuilt from them
+		_write<uint8_t>(_nodes, root.outline != nullptr);
+		if (root.outline) {
+			_write<uint32_t>(_nodes, root.outline->all_sections.size());
+			for (const std::shared_ptr<TexSection> &section: root.outline->all_sections)
+				_write_node_index(section->command);
+		}
+	}
+}
+
+void TexTreeEncoder::_write_node_index(const std::shared_ptr<TexElement> &element) {
+	auto it = element ? _node_indices.find(element.get()) : _node_indices.end();
+	_write(_nodes, it != _node_indices.end() ? it->second : TEX_PICKLE_NO_INDEX);
+}
+
+void TexTreeEncoder::_write_xref(const TexXref &xref) {
+	// commands that were edited out of the tree are written without an index and dropped
+	_write_node_index(xref.command);
+	_write_node_index(xref.env);
+	_write_node_index(xref.section);
+}
+
+void TexTreeEncoder::_write_xrefs(const TexXrefs &xrefs) {
+	_write<uint32_t>(_nodes, xrefs.labels.size());
+	for (const auto &[key, xref]: xrefs.labels) {
+		_write(_nodes, _intern(key));
+		_write_xref(xref);
+	}
+	for (const std::map<std::string, std::vector<TexXref>> *uses: {&xrefs.refs, &xrefs.cites}) {
+		_write<uint32_t>(_nodes, uses->size());
+		for (const auto &[key, key_xrefs]: *uses) {
+			_write(_nodes, _intern(key));
+			_write<uint32_t>(_nodes, key_xrefs.size());
+			for (const TexXref &xref: key_xrefs)
+				_write_xref(xref);
+		}
+	}
+}
+
+std::string TexTreeEncoder::encode(TexElement &element) {
+	element.update_positions();
+	_source_start = 0;
+	_index_nodes = typeid(element) == typeid(TexRoot) && (static_cast<TexRoot &>(element).xrefs ||
+			static_cast<TexRoot &>(element).outline);
+	if (element._string.has_value() && element.start_pos != static_cast<uint32_t>(-1)) {
+		_source = *element._string;
+		_source_start = element.start_pos;
+	}
+	_write_element(element);
+
+	std::string out;
+	size_t strings_size = 0;
+	for (const std::string *string: _strings)
+		strings_size += sizeof(uint32_t) + string->size();
+	out.reserve(4 * sizeof(uint32_t) + strings_size + _source.size() + _nodes.size());
+	_write(out, TEX_PICKLE_MAGIC);
+	_write<uint32_t>(out, _strings.size());
+	for (const std::string *string: _strings) {
+		_write<uint32_t>(out, string->size());
+		out += *string;
+	}
+	_write<uint32_t>(out, _source.size());
+	out += _source;
+	_write(out, _source_start);
+	out += _nodes;
+	return out;
+}
+
+std::string_view TexTreeDecoder::_read_bytes(size_t size) {
+	if (size > _data.size() - _pos)
+		throw std::runtime_error("corrupt pickled TeX element");
+	std::string_view bytes = _data.substr(_pos, size);
+	_pos += size;
+	return bytes;
+}
+
+std::string TexTreeDecoder::_read_string() {
+	uint32_t index = _read<uint32_t>();
+	if (index >= _strings.size())
+		throw std::runtime_error("corrupt pickled TeX element");
+	return std::string(_strings[index]);
+}
+
+std::shared_ptr<const std::string> TexTreeDecoder::_read_source_file(uint32_t index) {
+	if (index >= _strings.size())
+		throw std::runtime_error("corrupt pickled TeX element");
+	// elements from the same file share one path
+	std::shared_ptr<const std::string> &source_file = _source_files[index];
+	if (!source_file)
+		source_file = std::make_shared<const std::string>(_strings[index]);
+	return source_file;
+}
+
+std::optional<std::string>
+TexTreeDecoder::_read_cached_string(const TexElement &element, const std::string *text,
+		const std::optional<std::string> &outer) {
+	switch (_read<TexCachedString>()) {
+		case TexCachedString::NONE:
+			return {};
+		case TexCachedString::SOURCE: {
+			uint32_t offset = _read<uint32_t>();
+			uint32_t size = _read<uint32_t>();
+			if (offset > _source.size() || size > _source.size() - offset)
+				throw std::runtime_error("corrupt pickled TeX element");
+			return std::string(_source.substr(offset, size));
+		}
+		case TexCachedString::TEXT:
+			if (text == nullptr)
+				break;
+			return *text;
+		case TexCachedString::TABLE:
+			return _read_string();
+		case TexCachedString::DERIVED:
+			if (!outer.has_value())
+				break;
+			return outer->substr(element.start_delimiter.size(),
+					outer->size() - element.start_delimiter.size() - element.end_delimiter.size());
+	}
+	throw std::runtime_error("corrupt pickled TeX element");
+}
+
+std::shared_ptr<TexElement> TexTreeDecoder::_read_element() {
+	TexElementType type = _read<TexElementType>();
+	uint32_t start_pos = _read<uint32_t>();
+	uint16_t start_line = _read<uint16_t>();
+	uint32_t end_pos = _read<uint32_t>();
+	uint16_t end_line = _read<uint16_t>();
+	std::string start_delimiter = _read_string();
+	std::string end_delimiter = _read_string();
+	uint32_t source_file = _read<uint32_t>();
+	bool from_macro = _read<uint8_t>();
+
+	std::shared_ptr<TexElement> element;
+	const std::string *text = nullptr;
+	size_t index = _elements.size();
+	_elements.emplace_back();
+	switch (type) {
+		case TexElementType::COMMAND:
+			element = std::make_shared<TexCommand>(_read_string());
+			break;
+		case TexElementType::ARG:
+			element = std::make_shared<TexArg>();
+			break;
+		case TexElementType::ENV:
+			element = std::make_shared<TexEnv>(_read_string());
+			break;
+		case TexElementType::COMMENT: {
+			std::shared_ptr<TexComment> comment = std::make_shared<TexComment>(_read_string());
+			text = &comment->text;
+			element = comment;
+			break;
+		}
+		case TexElementType::TEXT: {
+			std::shared_ptr<TexText> text_element = std::make_shared<TexText>(_read_string());
+			text = &text_element->text;
+			element = text_element;
+			break;
+		}
+		case TexElementType::ROOT:
+			element = std::make_shared<TexRoot>();
+			break;
+		case TexElementType::ELEMENT:
+			element = std::make_shared<TexElement>(std::nullopt);
+			break;
+		default:
+			throw std::runtime_error("corrupt pickled TeX element");
+	}
+	_elements[index] = element;
+	element->start_pos = start_pos;
+	element->start_line = start_line;
+	element->end_pos = end_pos;
+	element->end_line = end_line;
+	element->start_delimiter = std::move(start_delimiter);
+	element->end_delimiter = std::move(end_delimiter);
+	if (source_file != TEX_PICKLE_NO_INDEX)
+		element->source_file = _read_source_file(source_file);
+	element->from_macro = from_macro;
+	element->_string = _read_cached_string(*element, text, {});
+	element->_inner_string = _read_cached_string(*element, text, element->_string);
+
+	uint32_t children_size = _read<uint32_t>();
+	std::vector<std::shared_ptr<TexElement>> children;
+	children.reserve(children_size);
+	for (uint32_t i = 0; i < children_size; i++)
+		children.push_back(_read_element());
+	element->children = py::cast(children);
+	element->adopt_children();
+
+	if (type == TexElementType::COMMAND) {
+		TexCommand &command = static_cast<TexCommand &>(*element);
+		command.args = py::list();
+		uint32_t args_size = _read<uint32_t>();
+		command._args_string.clear();
+		for (uint32_t i = 0; i < args_size; i++) {
+			uint32_t index = _read<uint32_t>();
+			std::shared_ptr<TexElement> arg;
+			if (index == TEX_PICKLE_NO_INDEX) {
+				arg = _read_element();
+				arg->parent = element;
+			} else if (index < children.size())
+				arg = children[index];
+			else
+				throw std::runtime_error("corrupt pickled TeX element");
+			command.args.append(py::cast(arg));
+			command._args_string += arg->_string.value_or("");
+		}
+		if (_read<TexCachedString>() == TexCachedString::TABLE)
+			command._args_string = _read_string();
+	} else if (type == TexElementType::ROOT) {
+		TexRoot &root = static_cast<TexRoot &>(*element);
+		root.length = _read<uint32_t>();
+		root.lines = _read<uint16_t>();
+		uint32_t diagnostics_size = _read<uint32_t>();
+		for (uint32_t i = 0; i < diagnostics_size; i++) {
+			std::string message = _read_string();
+			uint32_t pos = _read<uint32_t>();
+			uint16_t line = _read<uint16_t>();
+			root.diagnostics.push_back(TexDiagnostic{.message = message, .pos = pos, .line = line});
+		}
+		uint32_t macros_size = _read<uint32_t>();
+		for (uint32_t i = 0; i < macros_size; i++) {
+			TexMacro macro{.name = _read_string(), .num_args = _read<uint8_t>()};
+			if (_read<uint8_t>())
+				macro.default_arg = _read_string();
+			macro.body = _read_string();
+			macro.pos = _read<uint32_t>();
+			root.macros.emplace(macro.name, macro);
+		}
+		if (_read<uint8_t>())
+			root.xrefs = _read_xrefs();
+		if (_read<uint8_t>()) {
+			std::vector<std::shared_ptr<TexCommand>> section_commands;
+			uint32_t sections_size = _read<uint32_t>();
+			for (uint32_t i = 0; i < sections_size; i++) {
+				std::shared_ptr<TexCommand> command = _read_node<TexCommand>();
+				if (command)
+					section_commands.push_back(command);
+			}
+			root.outline = build_outline(section_commands);
+		}
+	}
+	element->update_hash();
+	return element;
+}
+
+std::optional<TexXref> TexTreeDecoder::_read_xref() {
+	TexXref xref{.command = _read_node<TexCommand>(), .env = _read_node<TexEnv>(),
+			.section = _read_node<TexCommand>()};
+	if (!xref.command)
+		return {};
+	return xref;
+}
+
+std::shared_ptr<TexXrefs> TexTreeDecoder::_read_xrefs() {
+	std::shared_ptr<TexXrefs> xrefs = std::make_shared<TexXrefs>();
+	uint32_t labels_size = _read<uint32_t>();
+	for (uint32_t i = 0; i < labels_size; i++) {
+		std::string key = _read_string();
+		std::optional<TexXref> xref = _read_xref();
+		if (xref.has_value())
+			xrefs->labels.emplace(key, xref.value());
+	}
+	for (std::map<std::string, std::vector<TexXref>> *uses: {&xrefs->refs, &xrefs->cites}) {
+		uint32_t keys_size = _read<uint32_t>();
+		for (uint32_t i = 0; i < keys_size; i++) {
+			std::string key = _read_string();
+			uint32_t xrefs_size = _read<uint32_t>();
+			for (uint32_t j = 0; j < xrefs_size; j++) {
+				std::optional<TexXref> xref = _read_xref();
+				if (xref.has_value())
+					(*uses)[key].push_back(xref.value());
+			}
+		}
+	}
+	return xrefs;
+}
+
+std::shared_ptr<TexElement> TexTreeDecoder::decode() {
+	if (_read<uint32_t>() != TEX_PICKLE_MAGIC)
+		throw std::runtime_error("not a pickled TeX element");
+	uint32_t strings_size = _read<uint32_t>();
+	_strings.reserve(strings_size);
+	for (uint32_t i = 0; i < strings_size; i++)
+		_strings.push_back(_read_bytes(_read<uint32_t>()));
+	_source = _read_bytes(_read<uint32_t>());
+	_read<uint32_t>(); // start position of the source
+	return _read_element();
+}
+
+std::string encode_tree(TexElement &element) {
+	return TexTreeEncoder().encode(element);
+}
+
+std::shared_ptr<TexElement> decode_tree(std::string_view data) {
+	return TexTreeDecoder(data).decode();
+}
@@ -0,0 +1,105 @@
+#include "tex_plaintext.h"
+
+static const std::string_view PLAINTEXT_ESCAPED_CHARS = "#$%&_{}";
+static const std::string_view PLAINTEXT_SPACE_CHARS = " ,;:";
+
+PlaintextExtractor::PlaintextExtractor(std::string_view source,
+		const std::vector<std::string> &keep_args_of, const std::vector<std::string> &drop_envs,
+		bool with_offsets) : scanner(source), with_offsets(with_offsets) {
+	this->keep_args_of.insert(keep_args_of.begin(), keep_args_of.end());
+	this->drop_envs.insert(drop_envs.begin(), drop_envs.end());
+}
+
+void PlaintextExtractor::extract() {
+	text.reserve(scanner.source.size());
+	if (with_offsets)
+		offsets.reserve(scanner.source.size());
+	_extract_range(0, scanner.source.size());
+}
+
+void PlaintextExtractor::_extract_range(size_t start, size_t end) {
+	size_t i = start;
+	while (i < end) {
+		char c = scanner.source[i];
+		switch (c) {
+			case '\\':
+				i = _extract_command(i, end);
+				break;
+			case '%':
+				i = std::min(scanner.skip_comment(i), end);
+				break;
+			case '{': {
+				bool closed;
+				size_t group_end = std::min(scanner.find_group_end(i, &closed), end);
+				_extract_range(i + 1, closed ? group_end - 1 : group_end);
+				i = group_end;
+				break;
+			}
+			case '}':
+				i++;
+				break;
+			case '~':
+				_emit(' ', i);
+				i++;
+				break;
+			default:
+				_emit(c, i);
+				i++;
+		}
+	}
+}
+
+size_t PlaintextExtractor::_extract_command(size_t i, size_t end) {
+	size_t name_end = scanner.read_command_name(i);
+	if (name_end == i + 1) {
+		if (i + 1 >= end)
+			return end;
+		char escaped = scanner.source[i + 1];
+		if (escaped == '\\')
+			_emit('\n', i);
+		else if (PLAINTEXT_SPACE_CHARS.find(escaped) != std::string_view::npos)
+			_emit(' ', i);
+		else if (PLAINTEXT_ESCAPED_CHARS.find(escaped) != std::string_view::npos)
+			_emit(escaped, i + 1);
+		return i + 2;
+	}
+
+	std::string_view name = scanner.source.substr(i + 1, name_end - i - 1);
+	if (name == "begin" || name == "end") {
+		std::optional<TexScannedArg> arg = scanner.next_arg(name_end);
+		if (!arg.has_value())
+			return name_end;
+		if (name == "begin" && drop_envs.contains(scanner.arg_text(*arg)))
+			return std::min(scanner.find_env_end(arg->end, scanner.arg_text(*arg)).second, end);
+		size_t args_end = arg->end;
+		if (name == "begin")
+			while ((arg = scanner.next_arg(args_end)).has_value())
+				args_end = arg->end;
+		return std::min(args_end, end);
+	}
+
+	bool keep_args = keep_args_of.contains(name);
+	size_t args_end = name_end;
+	std::optional<TexScannedArg> arg;
+	while ((arg = scanner.next_arg(args_end)).has_value() && arg->end <= end) {
+		if (keep_args && arg->start_delimiter == '{')
+			_extract_range(arg->inner_start(), arg->inner_end());
+		args_end = arg->end;
+	}
+	return args_end;
+}
+
+std::shared_ptr<TexPlaintext>
+to_plaintext(const std::string &source, const std::vector<std::string> &keep_args_of,
+		const std::vector<std::string> &drop_envs, bool offsets) {
+	PlaintextExtractor extractor(source, keep_args_of, drop_envs, offsets);
+	extractor.extract();
+
+	std::shared_ptr<TexPlaintext> result = std::make_shared<TexPlaintext>();
+	result->text = std::move(extractor.text);
+	if (offsets) {
+		result->offsets = std::make_shared<TexColumn<uint32_t>>();
+		result->offsets.value()->values = std::move(extractor.offsets);
+	}
+	return result;
+}
@@ -0,0 +1,396 @@
+#include "tex_project.h"
+
+const std::set<std::string, std::less<>> TEX_PROJECT_INCLUDE_COMMANDS = {"input", "include", "subfile"};
+
+static std::string trim_target(std::string_view target) {
+	size_t start = target.find_first_not_of(" \t\r\n");
+	if (start == std::string_view::npos)
+		return "";
+	return std::string(target.substr(start, target.find_last_not_of(" \t\r\n") + 1 - start));
+}
+
+static void set_source_file(TexElement &element, const std::shared_ptr<const std::string> &path) {
+	element.source_file = path;
+	for (py::handle child: element.children)
+		set_source_file(*py::cast<TexElement *>(child), path);
+}
+
+TexProjectLoader::TexProjectLoader(const std::string &main_tex, const std::vector<std::string> &search_paths,
+		ParseOptions options, size_t threads) : _options(options), _file_options(options), _threads(threads) {
+	// the outline spans files, so it is built once the tree is complete
+	_file_options.outline = false;
+	if (_threads == 0)
+		_threads = std::max(1u, std::thread::hardware_concurrency());
+	_main_dir = std::filesystem::path(main_tex).parent_path();
+	_search_paths.assign(search_paths.begin(), search_paths.end());
+	_main_key = _get_key(main_tex);
+	TexProjectFile &main_file = _files[_main_key];
+	main_file.path = main_tex;
+	main_file.uses = 1;
+	_queue.push_back(&main_file);
+}
+
+std::shared_ptr<TexRoot> TexProjectLoader::load() {
+	TexProjectFile &main_file = _files.at(_main_key);
+	{
+		// files are read and scanned for inclusions, then parsed, concurrently and without the GIL.
+		// In between, macros are expanded in document order, as files define macros for the files
+		// after them.
+		py::gil_scoped_release release;
+		_run_threads(&TexProjectLoader::_work);
+		if (_options.expand_macros && main_file.loaded)
+			_expand_macros(main_file);
+		for (auto &[key, file]: _files)
+			if (file.loaded && !file.parse_error.has_value())
+				_queue.push_back(&file);
+		_run_threads(&TexProjectLoader::_work_parse);
+	}
+
+	if (main_file.error.has_value())
+		throw std::runtime_error(main_file.error.value());
+	_root = _build(main_file);
+	main_file.merged = true;
+	_stack.push_back(&main_file);
+	_expand_includes(*_root, main_file);
+	_stack.pop_back();
+
+	if (_options.outline) {
+		std::vector<std::shared_ptr<TexCommand>> section_commands;
+		find_section_commands(*_root, section_commands);
+		_root->outline = build_outline(section_commands);
+	}
+	return _root;
+}
+
+void TexProjectLoader::_run_threads(void (TexProjectLoader::*work)()) {
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < _threads; i++)
+		threads.emplace_back(work, this);
+	for (std::thread &thread: threads)
+		thread.join();
+}
+
+void TexProjectLoader::_work() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true) {
+		_condition.wait(lock, [this] {
+			return !_queue.empty() || _active == 0;
+		});
+		if (_queue.empty())
+			return;
+		TexProjectFile *file = _queue.front();
+		_queue.pop_front();
+		_active++;
+
+		lock.unlock();
+		std::vector<std::pair<std::string, std::string>> included = _scan(*file);
+		lock.lock();
+
+		for (const auto &[key, path]: included) {
+			auto [it, inserted] = _files.try_emplace(key);
+			it->second.uses++;
+			if (inserted) {
+				it->second.path = path;
+				_queue.push_back(&it->second);
+			}
+		}
+		_active--;
+		_condition.notify_all();
+	}
+}
+
+void TexProjectLoader::_work_parse() {
+	while (true) {
+		TexProjectFile *file;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_queue.empty())
+				return;
+			file = _queue.front();
+			_queue.pop_front();
+		}
+		_parse(*file);
+	}
+}
+
+bool TexProjectLoader::_read(TexProjectFile &file) {
+	std::ifstream stream(file.path, std::ios::binary);
+	if (!stream.is_open()) {
+		file.error = "could not open file '" + file.path + "'";
+		return false;
+	}
+	file.source.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	file.loaded = true;
+	return true;
+}
+
+std::vector<std::pair<std::string, std::string>> TexProjectLoader::_scan(TexProjectFile &file) {
+	if (!_read(file))
+		return {};
+
+	// inclusions made by macro uses are only found when macros are expanded
+	std::string_view text = file.source;
+	TexScanner scanner(text);
+	std::vector<std::pair<std::string, std::string>> included;
+	std::unordered_map<std::string, std::string> paths;
+	size_t i = 0;
+	while (i < text.size()) {
+		if (text[i] == '%') {
+			i = scanner.skip_comment(i);
+			continue;
+		} else if (text[i] != '\\') {
+			i++;
+			continue;
+		}
+
+		size_t name_end = scanner.read_command_name(i);
+		if (name_end == i + 1) {
+			i += 2;
+			continue;
+		}
+		std::string_view name = text.substr(i + 1, name_end - i - 1);
+		i = name_end;
+		if (!TEX_PROJECT_INCLUDE_COMMANDS.contains(name))
+			continue;
+		std::optional<TexScannedArg> arg = scanner.next_arg(name_end);
+		if (!arg.has_value() || arg->start_delimiter != '{' || !arg->closed)
+			continue;
+		i = arg->end;
+
+		std::string target = trim_target(scanner.arg_text(*arg));
+		auto [it, inserted] = file.targets.try_emplace(target);
+		if (inserted) {
+			std::optional<std::filesystem::path> path = _resolve(target, file, name == "subfile");
+			if (path.has_value()) {
+				it->second = _get_key(*path);
+				paths[*it->second] = path->string();
+			}
+		}
+		if (it->second.has_value())
+			included.emplace_back(*it->second, paths[*it->second]);
+	}
+	return included;
+}
+
+std::optional<std::filesystem::path> TexProjectLoader::_resolve(const std::string &target,
+		const TexProjectFile &file, bool relative_to_file) const {
+	// like LaTeX, paths are relative to the main file, except for subfiles
+	std::vector<std::filesystem::path> dirs = {_main_dir};
+	std::filesystem::path file_dir = std::filesystem::path(file.path).parent_path();
+	if (file_dir != _main_dir)
+		dirs.insert(relative_to_file ? dirs.begin() : dirs.end(), file_dir);
+	dirs.insert(dirs.end(), _search_paths.begin(), _search_paths.end());
+
+	std::error_code error;
+	for (const std::filesystem::path &dir: dirs) {
+		for (const std::string &name: {target + ".tex", target}) {
+			std::filesystem::path path = dir / name;
+			if (std::filesystem::is_regular_file(path, error))
+				return path.lexically_normal();
+		}
+	}
+	return {};
+}
+
+TexProjectFile *TexProjectLoader::_find_included(TexProjectFile &file, std::string_view command,
+		const std::string &target) {
+	auto target_it = file.targets.find(target);
+	if (target_it == file.targets.end()) {
+		// inclusions made by macro uses are not seen by the scanner, and are resolved when met
+		std::optional<std::filesystem::path> path = _resolve(target, file, command == "subfile");
+		target_it = file.targets.try_emplace(target).first;
+		if (path.has_value()) {
+			target_it->second = _get_key(*path);
+			auto [it, inserted] = _files.try_emplace(*target_it->second);
+			if (inserted)
+				it->second.path = path->string();
+		}
+	}
+	if (!target_it->second.has_value())
+		return nullptr;
+	return &_files.at(target_it->second.value());
+}
+
+void TexProjectLoader::_expand_macros(TexProjectFile &file) {
+	_expanding.push_back(&file);
+	MacroExpander expander(file.source, _options.max_expansion_depth, _options.max_expansion_size,
+			_options.recover, _macros);
+	expander.on_include = [this, &file](std::string_view command, std::string_view target,
+			std::map<std::string, TexMacro, std::less<>> &macros) {
+		// missing files and cycles are reported when the tree is built
+		TexProjectFile *included = _find_included(file, command, trim_target(target));
+		if (included == nullptr || included->error.has_value() ||
+				std::find(_expanding.begin(), _expanding.end(), included) != _expanding.end() ||
+				(!included->loaded && !_read(*included)))
+			return;
+		_macros = macros;
+		_expand_macros(*included);
+		// definitions only add or replace macros, so the table is updated in place, which keeps the
+		// macro whose use made the inclusion valid
+		for (const auto &[name, macro]: _macros)
+			macros.insert_or_assign(name, macro);
+	};
+	try {
+		TexMacroExpansion expansion = expander.expand();
+		_macros = expansion.macros;
+		// a file included more than once is parsed once, with the macros of its first inclusion
+		if (file.expansion.has_value())
+			file.uses = std::max<size_t>(file.uses, 2);
+		else
+			file.expansion = std::move(expansion);
+	} catch (const std::runtime_error &error) {
+		if (!file.parse_error.has_value())
+			file.parse_error = file.path + ": " + error.what();
+	}
+	_expanding.pop_back();
+}
+
+void TexProjectLoader::_parse(TexProjectFile &file) {
+	file.parsed = std::make_unique<ParseInfo>(_file_options);
+	try {
+		if (file.expansion.has_value()) {
+			file.parsed->expansion = std::move(file.expansion);
+			file.expansion.reset();
+		}
+		process_string(*file.parsed, file.source);
+		finish_parse(*file.parsed);
+	} catch (const std::runtime_error &error) {
+		file.parse_error = file.path + ": " + error.what();
+		file.parsed.reset();
+	}
+	std::string().swap(file.source);
+	file.loaded = false;
+}
+
+std::shared_ptr<TexRoot> TexProjectLoader::_build(TexProjectFile &file) {
+	if (file.parse_error.has_value())
+		throw std::runtime_error(file.parse_error.value());
+	std::shared_ptr<TexRoot> root = build_root(*file.parsed);
+	file.parsed.reset();
+	set_source_file(*root, std::make_shared<const std::string>(file.path));
+
+	// files used more than once are pickled before splicing, so that later uses can be copied
+	if (file.uses > 1)
+		file.encoded = encode_tree(*root);
+	return root;
+}
+
+void TexProjectLoader::_expand_includes(TexElement &element, TexProjectFile &file) {
+	size_t i = 0;
+	while (i < element.children.size()) {
+		std::shared_ptr<TexElement> child = py::cast<std::shared_ptr<TexElement>>(element.children[i]);
+		// inclusions in arguments, such as in a \newcommand body, are left as they are
+		if (typeid(*child) == typeid(TexArg)) {
+			i++;
+			continue;
+		}
+		if (typeid(*child) == typeid(TexCommand)) {
+			std::optional<std::vector<std::shared_ptr<TexElement>>> elements = _include(
+					static_cast<TexCommand &>(*child), file);
+			if (elements.has_value()) {
+				// the included elements keep the positions they have in their own file
+				element._splice_children(i, i + 1, *elements, false);
+				i += elements->size();
+				continue;
+			}
+		}
+		_expand_includes(*child, file);
+		i++;
+	}
+}
+
+std::optional<std::vector<std::shared_ptr<TexElement>>> TexProjectLoader::_include(TexCommand &command,
+		TexProjectFile &file) {
+	if (!TEX_PROJECT_INCLUDE_COMMANDS.contains(command.name))
+		return {};
+	std::shared_ptr<TexArg> arg;
+	for (py::handle handle: command.args) {
+		arg = py::cast<std::shared_ptr<TexArg>>(handle);
+		if (arg->start_delimiter == "{")
+			break;
+		arg.reset();
+	}
+	if (!arg)
+		return {};
+	std::string target = trim_target(arg->inner_string());
+	TexProjectFile *included_file = _find_included(file, command.name, target);
+	if (included_file == nullptr) {
+		_report_error("could not find file '" + target + "' included on line " +
+				std::to_string(command.start_line) + " of '" + file.path + "'", command.start_pos,
+				command.start_line);
+		return {};
+	}
+	TexProjectFile &included = *included_file;
+	if (std::find(_stack.begin(), _stack.end(), &included) != _stack.end()) {
+		std::string cycle;
+		for (auto it = std::find(_stack.begin(), _stack.end(), &included); it != _stack.end(); it++)
+			cycle += (*it)->path + " -> ";
+		_report_error("inclusion cycle " + cycle + included.path + " on line " +
+				std::to_string(command.start_line) + " of '" + file.path + "'", command.start_pos,
+				command.start_line);
+		return {};
+	}
+
+	// files are read and parsed here if the loader threads did not see them, or if their tree was
+	// already used by an inclusion the scanner did not count
+	if (!included.parsed && included.encoded.empty() && !included.parse_error.has_value() &&
+			!included.error.has_value()) {
+		py::gil_scoped_release release;
+		if (_read(included)) {
+			if (_options.expand_macros)
+				_expand_macros(included);
+			if (!included.parse_error.has_value())
+				_parse(included);
+		}
+	}
+	if (included.error.has_value()) {
+		_report_error(included.error.value(), command.start_pos, command.start_line);
+		return {};
+	}
+
+	std::shared_ptr<TexRoot> root;
+	if (!included.encoded.empty())
+		root = std::static_pointer_cast<TexRoot>(decode_tree(included.encoded));
+	else
+		root = _build(included);
+	_stack.push_back(&included);
+	_expand_includes(*root, included);
+	_stack.pop_back();
+
+	if (!included.merged) {
+		if (root->xrefs) {
+			if (!_root->xrefs)
+				_root->xrefs = std::make_shared<TexXrefs>();
+			_root->xrefs->merge(*root->xrefs, root->diagnostics);
+		}
+		for (const TexDiagnostic &diagnostic: root->diagnostics)
+			_root->diagnostics.push_back(TexDiagnostic{.message = included.path + ": " + diagnostic.message,
+					.pos = diagnostic.pos, .line = diagnostic.line});
+		// the macros of the main file, expanded in document order, already include those of the files
+		// it includes, so only files found while splicing add any
+		_root->macros.insert(root->macros.begin(), root->macros.end());
+		included.merged = true;
+	}
+
+	// subfiles are complete documents, of which only the body is included
+	TexElement *container = root.get();
+	std::optional<std::shared_ptr<TexEnv>> document;
+	if (command.name == "subfile" && (document = root->find_env("document")).has_value())
+		container = document->get();
+	std::vector<std::shared_ptr<TexElement>> elements;
+	elements.reserve(container->children.size());
+	for (py::handle handle: container->children)
+		elements.push_back(py::cast<std::shared_ptr<TexElement>>(handle));
+	return elements;
+}
+
+void TexProjectLoader::_report_error(std::string message, uint32_t pos, uint16_t line) {
+	if (!_options.recover)
+		throw std::runtime_error(message);
+	_root->diagnostics.push_back(TexDiagnostic{.message = message, .pos = pos, .line = line});
+}
+
+std::shared_ptr<TexRoot> parse_project(const std::string &main_tex,
+		const std::vector<std::string> &search_paths, ParseOptions options, size_t threads) {
+	return TexProjectLoader(main_tex, search_paths, options, threads).load();
+}
@@ -0,0 +1,121 @@
+#include "tex_rewrite.h"
+
+#include <fstream>
+#include <sstream>
+
+TexRewriter::TexRewriter(std::string_view source, const TexRewriteRules &rules, std::ostream &out)
+		: scanner(source), out(out), drop_comments(rules.drop_comments) {
+	rename_commands.insert(rules.rename_commands.begin(), rules.rename_commands.end());
+	rename_envs.insert(rules.rename_envs.begin(), rules.rename_envs.end());
+	delete_commands.insert(rules.delete_commands.begin(), rules.delete_commands.end());
+	delete_envs.insert(rules.delete_envs.begin(), rules.delete_envs.end());
+	replace_with_arg.insert(rules.replace_with_arg.begin(), rules.replace_with_arg.end());
+}
+
+void TexRewriter::rewrite() {
+	_rewrite_range(0, scanner.source.size());
+}
+
+std::vector<TexScannedArg> TexRewriter::_read_args(size_t i, size_t end) const {
+	std::vector<TexScannedArg> args;
+	std::optional<TexScannedArg> arg;
+	while ((arg = scanner.next_arg(i)).has_value() && arg->end <= end) {
+		args.push_back(*arg);
+		i = arg->end;
+	}
+	return args;
+}
+
+void TexRewriter::_rewrite_range(size_t start, size_t end) {
+	size_t copied = start;
+	size_t i = start;
+	while (i < end) {
+		char c = scanner.source[i];
+		if (c == '%') {
+			size_t comment_end = std::min(scanner.skip_comment(i), end);
+			if (drop_comments) {
+				_copy(copied, i);
+				copied = comment_end;
+			}
+			i = comment_end;
+			continue;
+		}
+		if (c != '\\') {
+			i++;
+			continue;
+		}
+
+		size_t name_end = scanner.read_command_name(i);
+		if (name_end == i + 1) {
+			i = std::min(i + 2, end);
+			continue;
+		}
+		std::string_view name = scanner.source.substr(i + 1, name_end - i - 1);
+
+		if (name == "begin" || name == "end") {
+			std::optional<TexScannedArg> arg = scanner.next_arg(name_end);
+			if (!arg.has_value() || arg->start_delimiter != '{' || !arg->closed || arg->end > end) {
+				i = name_end;
+				continue;
+			}
+			std::string_view env_name = scanner.arg_text(*arg);
+			if (name == "begin" && delete_envs.contains(env_name)) {
+				_copy(copied, i);
+				copied = i = std::min(scanner.find_env_end(arg->end, env_name).second, end);
+				continue;
+			}
+			auto renamed = rename_envs.find(env_name);
+			if (renamed != rename_envs.end()) {
+				_copy(copied, arg->inner_start());
+				out << renamed->second;
+				copied = arg->inner_end();
+			}
+			i = arg->end;
+			continue;
+		}
+
+		if (delete_commands.contains(name)) {
+			std::vector<TexScannedArg> args = _read_args(name_end, end);
+			_copy(copied, i);
+			copied = i = args.empty() ? name_end : args.back().end;
+			continue;
+		}
+
+		auto replaced = replace_with_arg.find(name);
+		if (replaced != replace_with_arg.end()) {
+			std::vector<TexScannedArg> args = _read_args(name_end, end);
+			if (replaced->second < args.size()) {
+				const TexScannedArg &arg = args[replaced->second];
+				_copy(copied, i);
+				_rewrite_range(arg.inner_start(), arg.inner_end());
+				copied = i = args.back().end;
+				continue;
+			}
+		}
+
+		auto renamed = rename_commands.find(name);
+		if (renamed != rename_commands.end()) {
+			_copy(copied, i + 1);
+			out << renamed->second;
+			copied = name_end;
+		}
+		i = name_end;
+	}
+	_copy(copied, end);
+}
+
+std::optional<std::string>
+rewrite(std::string_view source, const TexRewriteRules &rules,
+		const std::optional<std::string> &output_path) {
+	if (output_path.has_value()) {
+		std::ofstream file(output_path.value(), std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not open " + output_path.value() + " for writing");
+		TexRewriter(source, rules, file).rewrite();
+		return {};
+	}
+
+	std::ostringstream out;
+	TexRewriter(source, rules, out).rewrite();
+	return out.str();
+}
@@ -0,0 +1,67 @@
+#include "tex_scanner.h"
+
+size_t TexScanner::find_group_end(size_t i, bool *closed) const {
+	char end_delimiter = source[i] == '[' ? ']' : '}';
+	uint32_t depth = 0;
+	for (i++; i < source.size(); i++) {
+		char c = source[i];
+		if (c == '\\')
+			i++;
+		else if (c == '%')
+			i = skip_comment(i) - 1;
+		else if (c == '{')
+			depth++;
+		else if (c == '}' && depth > 0)
+			depth--;
+		else if (c == end_delimiter && depth == 0) {
+			if (closed)
+				*closed = true;
+			return i + 1;
+		}
+	}
+	if (closed)
+		*closed = false;
+	return source.size();
+}
+
+std::optional<TexScannedArg> TexScanner::next_arg(size_t i) const {
+	while (i < source.size() && source[i] == ' ')
+		i++;
+	if (i >= source.size() || (source[i] != '{' && source[i] != '['))
+		return {};
+	TexScannedArg arg{.start = i, .start_delimiter = source[i]};
+	arg.end = find_group_end(i, &arg.closed);
+	return arg;
+}
+
+std::pair<size_t, size_t> TexScanner::find_env_end(size_t i, std::string_view name) const {
+	uint32_t depth = 0;
+	while (i < source.size()) {
+		char c = source[i];
+		if (c == '%') {
+			i = skip_comment(i);
+			continue;
+		}
+		if (c != '\\') {
+			i++;
+			continue;
+		}
+		size_t start = i;
+		size_t name_end = read_command_name(i);
+		std::string_view command = source.substr(i + 1, name_end - i - 1);
+		i = std::max(name_end, i + 2);
+		if (command != "begin" && command != "end")
+			continue;
+		std::optional<TexScannedArg> arg = next_arg(name_end);
+		if (!arg.has_value() || arg->start_delimiter != '{' || arg_text(*arg) != name)
+			continue;
+		i = arg->end;
+		if (command == "begin")
+			depth++;
+		else if (depth == 0)
+			return {start, arg->end};
+		else
+			depth--;
+	}
+	return {source.size(), source.size()};
+}
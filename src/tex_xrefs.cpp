@@ -0,0 +1,126 @@
+#include "tex_xrefs.h"
+
+const std::set<std::string, std::less<>> TEX_XREF_REF_COMMANDS = {
+		"ref", "eqref", "pageref", "autoref", "nameref", "vref", "cref", "Cref", "cpageref", "Cpageref",
+		"labelcref"};
+
+const std::set<std::string, std::less<>> TEX_XREF_MULTI_REF_COMMANDS = {
+		"cref", "Cref", "cpageref", "Cpageref", "labelcref"};
+
+const std::set<std::string, std::less<>> TEX_XREF_CITE_COMMANDS = {
+		"cite", "Cite", "nocite", "citep", "Citep", "citet", "Citet", "citealp", "citealt", "citeauthor",
+		"citeyear", "parencite", "Parencite", "textcite", "Textcite", "autocite", "Autocite", "footcite",
+		"smartcite", "supercite", "fullcite"};
+
+std::string TexXref::__repr__() const {
+	std::string r = "TexXref(\\" + command->name;
+	if (env)
+		r += " in " + env->name;
+	if (section)
+		r += " under \\" + section->name;
+	return r + ")";
+}
+
+void TexXrefs::merge(const TexXrefs &other, std::vector<TexDiagnostic> &diagnostics) {
+	for (const auto &[key, xref]: other.labels)
+		if (!labels.emplace(key, xref).second)
+			diagnostics.push_back(TexDiagnostic{.message = "label '" + key + "' defined multiple times",
+					.pos = xref.command->start_pos, .line = xref.command->start_line});
+	for (const auto &[key, xrefs]: other.refs)
+		refs[key].insert(refs[key].end(), xrefs.begin(), xrefs.end());
+	for (const auto &[key, xrefs]: other.cites)
+		cites[key].insert(cites[key].end(), xrefs.begin(), xrefs.end());
+}
+
+void TexXrefCollector::reset() {
+	_entries.clear();
+	_section.reset();
+}
+
+void TexXrefCollector::trim(size_t max_retained_bytes) {
+	trim_buffer(_entries, max_retained_bytes);
+}
+
+void TexXrefCollector::add(const std::shared_ptr<TexCommand> &command) {
+	if (TEX_SECTION_LEVELS.contains(command->name)) {
+		_section = command;
+		return;
+	}
+
+	TexXrefKind kind;
+	if (command->name == "label")
+		kind = TexXrefKind::LABEL;
+	else if (TEX_XREF_REF_COMMANDS.contains(command->name))
+		kind = TexXrefKind::REF;
+	else if (TEX_XREF_CITE_COMMANDS.contains(command->name))
+		kind = TexXrefKind::CITE;
+	else
+		return;
+
+	// the keys are in the last mandatory argument, after any optional ones such as \citep[p. 2]{key}
+	if (!command->last_mandatory_arg())
+		return;
+	_add_keys(kind, command->last_mandatory_arg_text(), kind == TexXrefKind::CITE ||
+			TEX_XREF_MULTI_REF_COMMANDS.contains(command->name), command);
+}
+
+void TexXrefCollector::_add_keys(TexXrefKind kind, std::string_view keys, bool split,
+		const std::shared_ptr<TexCommand> &command) {
+	size_t start = 0;
+	while (start <= keys.size()) {
+		size_t end = split ? keys.find(',', start) : std::string_view::npos;
+		if (end == std::string_view::npos)
+			end = keys.size();
+		std::string_view key = keys.substr(start, end - start);
+		size_t key_start = key.find_first_not_of(" \t\r\n");
+		if (key_start != std::string_view::npos) {
+			key = key.substr(key_start, key.find_last_not_of(" \t\r\n") + 1 - key_start);
+			_entries.push_back(Entry{.kind = kind, .key = std::string(key), .command = command,
+					.section = _section});
+		}
+		start = end + 1;
+	}
+}
+
+TexXref TexXrefCollector::_resolve(const Entry &entry) {
+	// parent links are only complete once the whole tree is built
+	TexXref xref{.command = entry.command, .section = entry.section};
+	bool in_section = false;
+	for (std::shared_ptr<TexElement> element = entry.command->get_parent(); element;
+			element = element->get_parent()) {
+		TexElementType type = get_element_type(*element);
+		if (type == TexElementType::ENV && !xref.env &&
+				static_cast<TexEnv &>(*element).name != "document")
+			xref.env = std::static_pointer_cast<TexEnv>(element);
+		else if (type == TexElementType::COMMAND && !in_section &&
+				TEX_SECTION_LEVELS.contains(static_cast<TexCommand &>(*element).name)) {
+			// e.g. \section{Introduction\label{sec:intro}}
+			xref.section = std::static_pointer_cast<TexCommand>(element);
+			in_section = true;
+		}
+	}
+	return xref;
+}
+
+std::shared_ptr<TexXrefs> TexXrefCollector::finish(std::vector<TexDiagnostic> &diagnostics) {
+	std::shared_ptr<TexXrefs> xrefs = std::make_shared<TexXrefs>();
+	for (const Entry &entry: _entries) {
+		TexXref xref = _resolve(entry);
+		switch (entry.kind) {
+			case TexXrefKind::LABEL:
+				if (!xrefs->labels.emplace(entry.key, xref).second)
+					diagnostics.push_back(TexDiagnostic{.message = "label '" + entry.key +
+							"' defined multiple times", .pos = entry.command->start_pos,
+							.line = entry.command->start_line});
+				break;
+			case TexXrefKind::REF:
+				xrefs->refs[entry.key].push_back(xref);
+				break;
+			case TexXrefKind::CITE:
+				xrefs->cites[entry.key].push_back(xref);
+				break;
+		}
+	}
+	reset();
+	return xrefs;
+}
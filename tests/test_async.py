@@ -0,0 +1,66 @@
+import asyncio
+import threading
+
+import pytest
+
+from fast_tex_parser import parse, parse_async, parse_file_async
+
+
+def test_parse_async_matches_parse():
+    source = "\\section{a}\\label{x} b \\ref{x}"
+
+    async def run():
+        return await parse_async(source, xrefs=True)
+
+    root = asyncio.run(run())
+    assert root.repr() == parse(source).repr()
+    assert list(root.xrefs.labels) == ["x"]
+
+
+def test_parse_file_async(tmp_path):
+    path = tmp_path / "main.tex"
+    path.write_text("\\textbf{a}")
+
+    async def run():
+        return await parse_file_async(str(path))
+
+    assert asyncio.run(run()).string == "\\textbf{a}"
+
+
+def test_errors_are_set_on_the_future():
+    async def run():
+        return await parse_async("a {b}")
+
+    with pytest.raises(RuntimeError):
+        asyncio.run(run())
+
+
+def test_other_threads_run_while_parsing():
+    source = "\\textbf{a} b\n" * 200000
+    ticks = []
+    stop = threading.Event()
+
+    def tick():
+        while not stop.is_set():
+            ticks.append(None)
+
+    async def run():
+        thread = threading.Thread(target=tick)
+        thread.start()
+        try:
+            return await parse_async(source)
+        finally:
+            stop.set()
+            thread.join()
+
+    assert asyncio.run(run()).string == source
+    assert ticks
+
+
+def test_cancelled_parse():
+    async def run():
+        future = parse_async("\\textbf{a} b\n" * 100000)
+        future.cancel()
+        return await parse_async("c")
+
+    assert asyncio.run(run()).string == "c"
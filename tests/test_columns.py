@@ -0,0 +1,36 @@
+from fast_tex_parser import parse, TexColumns
+
+
+def values(column):
+    return memoryview(column).tolist()
+
+
+def test_columns_are_in_document_order():
+    columns = parse("\\textbf{a}").to_columns()
+    assert len(columns) == 4
+    assert [TexColumns.type_names[t] for t in values(columns.type)] == \
+           ["TexRoot", "TexCommand", "TexArg", "TexText"]
+    assert values(columns.depth) == [0, 1, 2, 3]
+    assert values(columns.parent) == [-1, 0, 1, 2]
+
+
+def test_names_are_interned():
+    columns = parse("\\a \\b \\a").to_columns()
+    names = [columns.names[i] if i >= 0 else None for i in values(columns.name)]
+    assert [name for name in names if name is not None] == ["a", "b", "a"]
+    assert sorted(columns.names) == ["a", "b"]
+
+
+def test_columns_of_a_subtree():
+    root = parse("\\begin{document}x\\end{document}")
+    columns = root.find_env("document").to_columns()
+    assert values(columns.depth)[0] == 0
+    assert values(columns.parent)[0] == -1
+    assert columns.names == ["document"]
+
+
+def test_column_formats():
+    columns = parse("x").to_columns()
+    assert memoryview(columns.type).format == "B"
+    assert memoryview(columns.start_pos).format == "I"
+    assert memoryview(columns.parent).format == "i"
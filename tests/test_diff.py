@@ -0,0 +1,41 @@
+from fast_tex_parser import TexText, diff, find_duplicates, parse
+
+
+def test_identical_trees_have_no_differences():
+    a = parse("x \\textbf{a} y \\emph{b} z")
+    b = parse("x \\textbf{a} y \\emph{b} z")
+    assert a.structural_hash == b.structural_hash
+    result = diff(a, b)
+    assert (result.inserted, result.deleted, result.modified) == ([], [], [])
+
+
+def test_change_is_reported_on_innermost_element():
+    a = parse("x \\textbf{a} y \\emph{b} z")
+    b = parse("x \\textbf{a} y \\emph{c} z")
+    result = diff(a, b)
+    assert [(old.string, new.string) for old, new in result.modified] == [("b", "c")]
+
+
+def test_hash_follows_in_place_list_edits():
+    a = parse("x \\textbf{a} y")
+    b = parse("x \\textbf{a} y")
+    before = b.structural_hash
+    b.children[1].children.append(TexText("q"))
+    assert b.structural_hash != before
+    result = diff(a, b)
+    assert [element.string for element in result.inserted] == ["q"]
+
+
+def test_hash_follows_edits():
+    root = parse("a \\b{c} d")
+    before = root.structural_hash
+    root.find_command("b").args[0].children[0].replace_with(TexText("z"))
+    assert root.structural_hash != before
+    assert root.structural_hash == parse("a \\b{z} d").structural_hash
+
+
+def test_duplicates_are_grouped():
+    root = parse("\\a{\\b{c}{d}} \\a{\\b{c}{d}} \\a{\\b{c}{e}}")
+    groups = find_duplicates(root, min_nodes=3)
+    assert len(groups) == 1
+    assert [element.outer_string for element in groups[0]] == ["\\a{\\b{c}{d}}"] * 2
@@ -0,0 +1,74 @@
+import pytest
+
+from fast_tex_parser import TexArg, TexCommand, TexText, parse
+
+SOURCE = "a\\x{b}\nc\\y{d}\\begin{f}g\\end{f}h"
+
+
+def test_parents_are_set_by_the_parser():
+    root = parse(SOURCE)
+    command = root.find_command("x")
+    assert command.parent is root
+    assert command.args[0].parent is command
+
+
+def test_insert_and_remove():
+    root = parse(SOURCE)
+    root.find_command("x").insert_before(TexText("XX"))
+    root.find_command("y").remove()
+    root.find_command("x").insert_after(TexText("YY"))
+    assert root.string == "aXX\\x{b}YY\nc\\begin{f}g\\end{f}h"
+
+
+def test_repeated_edits_after_removals():
+    root = parse("".join("\\c%d " % i for i in range(50)))
+    commands = [root.find_command("c%d" % i) for i in range(50)]
+    for command in commands[::2]:
+        command.remove()
+    for command in commands[1::2]:
+        command.insert_after(TexText("!"))
+    assert root.string == "".join(" \\c%d! " % i for i in range(1, 50, 2))
+
+
+def test_positions_are_updated_after_edits():
+    root = parse(SOURCE)
+    root.find_command("x").replace_with(TexText("long\ntext"))
+    env = root.find_env("f")
+    assert root.string[env.start_pos:env.end_pos + 1] == "\\begin{f}g\\end{f}"
+    assert env.start_line == 2
+    assert root.length == len(root.string)
+
+
+def test_edits_do_not_move_unrelated_positions():
+    root = parse("a\\x{b} c\\y d")
+    commands = [root.find_command("x"), root.find_command("y")]
+    before = [(command.start_pos, command.end_pos) for command in commands]
+    assert before == [(1, 5), (8, 9)]
+    assert root.length == 12
+    root.children[0].text = "z"
+    assert [(command.start_pos, command.end_pos) for command in commands] == before
+    assert root.length == 12
+
+
+def test_elements_have_one_parent():
+    root = parse(SOURCE)
+    other = parse("z")
+    with pytest.raises(RuntimeError):
+        root.children = other.children
+    with pytest.raises(RuntimeError):
+        root.find_command("y").insert_after(other.children[0])
+    root.children = root.children[::-1]
+    assert root.children[0].parent is root
+
+
+def test_args_setter_sets_parents_and_hashes():
+    root = parse(SOURCE)
+    command = root.find_command("x")
+    hash_before = root.structural_hash
+    arg = TexArg("[", "]", [TexText("o")])
+    command.args = [arg]
+    assert arg.parent is command
+    assert root.structural_hash != hash_before
+    assert root.string.startswith("a\\x[o]\n")
+    with pytest.raises(RuntimeError):
+        command.args = [TexText("t")]
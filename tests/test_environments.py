@@ -0,0 +1,30 @@
+from fast_tex_parser import TexEnv, parse
+
+
+def test_short_environments():
+    root = parse("\\begin{a}x\\end{a}y")
+    env = root.children[0]
+    assert isinstance(env, TexEnv)
+    assert env.start_pos == 0
+    assert env.string == "\\begin{a}x\\end{a}"
+    assert root.string == "\\begin{a}x\\end{a}y"
+
+
+def test_nested_environments_start_at_their_begin():
+    root = parse("x\\begin{a}\\begin{b}y\\end{b}\\end{a}")
+    a = root.children[1]
+    b = a.children[0]
+    assert (a.start_pos, a.end_pos) == (1, 33)
+    assert (b.start_pos, b.end_pos) == (10, 26)
+    assert b.string == "\\begin{b}y\\end{b}"
+
+
+def test_environment_followed_by_command():
+    root = parse("\\begin{a}\\foo\\end{a}\\bar")
+    assert [child.name for child in root.children] == ["a", "bar"]
+    assert root.children[0].children[0].name == "foo"
+
+
+def test_text_after_end_belongs_to_parent():
+    root = parse("\\begin{a}x\\end{a} y")
+    assert root.children[1].text == " y"
@@ -0,0 +1,66 @@
+import pickle
+
+import pytest
+
+from fast_tex_parser import Parser, parse, rewrite, TexRewriteRules
+
+
+def test_recover_is_positional():
+    assert len(parse("a {b} c", True).diagnostics) == 1
+    assert len(Parser(True).parse("a {b} c").diagnostics) == 1
+    with pytest.raises(TypeError):
+        parse("a", False, True)
+
+
+def test_def_with_space_before_body():
+    root = parse("\\def\\foo {x}\\foo", expand_macros=True)
+    assert root.macros["foo"].body == "x"
+    assert root.string.endswith("}x")
+
+
+def test_memoized_expansion_respects_depth():
+    source = "\\def\\a{x}\\def\\b{\\a}\\def\\c{\\b}\\b \\c"
+    with pytest.raises(RuntimeError):
+        parse(source, expand_macros=True, max_expansion_depth=2)
+    root = parse(source, True, expand_macros=True, max_expansion_depth=2)
+    assert root.string.endswith("}x \\c")
+    assert len(root.diagnostics) == 1
+    assert "depth" in root.diagnostics[0].message
+
+
+def test_size_limit_keeps_rest_unexpanded():
+    source = "\\def\\a{xxxxxxxxxx}\\a\\a\\a \\a"
+    with pytest.raises(RuntimeError):
+        parse(source, expand_macros=True, max_expansion_size=40)
+    root = parse(source, True, expand_macros=True, max_expansion_size=40)
+    assert root.string == "\\def\\a{xxxxxxxxxx}" + "x" * 20 + "\\a \\a"
+    assert len(root.diagnostics) == 1
+    assert "size" in root.diagnostics[0].message
+
+
+def test_expanded_elements_are_marked():
+    source = "\\newcommand{\\foo}[1]{\\textbf{#1}}\na \\foo{b} c"
+    root = parse(source, expand_macros=True)
+    definition, before, command, after = root.children
+    assert command.name == "textbf"
+    assert command.from_macro
+    assert command.start_pos == source.index("\\foo{b}")
+    assert command.end_pos >= source.index("} c")
+    assert not definition.from_macro and not before.from_macro and not after.from_macro
+    assert root.from_macro
+    assert not parse(source).from_macro
+
+
+def test_marks_survive_pickling():
+    root = parse("\\def\\foo{\\bar}\\foo", expand_macros=True)
+    copy = pickle.loads(pickle.dumps(root))
+    assert [child.from_macro for child in copy.children] == [child.from_macro for child in root.children]
+    assert copy.children[-1].from_macro
+
+
+def test_expanded_elements_are_not_rewritten():
+    root = parse("\\def\\foo{\\bar}\\foo", expand_macros=True)
+    rules = TexRewriteRules(rename_commands={"bar": "baz"})
+    with pytest.raises(ValueError):
+        rewrite(root.children[-1], rules)
+    assert rewrite(root.children[0], rules) == "\\def"
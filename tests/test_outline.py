@@ -0,0 +1,46 @@
+import pytest
+
+from fast_tex_parser import parse
+
+SOURCE = "intro \\section{A} a text \\subsection{B} b \\section{C} c"
+
+
+def test_sections_nest_by_level():
+    root = parse(SOURCE, outline=True)
+    assert [section.title for section in root.outline.sections] == ["A", "C"]
+    assert [section.title for section in root.outline.sections[0].subsections] == ["B"]
+    assert [section.title for section in root.outline.all_sections] == ["A", "B", "C"]
+
+
+def test_content_spans_up_to_the_next_heading():
+    root = parse(SOURCE, outline=True)
+    a, b, c = root.outline.all_sections
+    assert a.content.string == " a text \\subsection{B} b "
+    assert b.content.string == " b "
+    assert c.content.string == " c"
+
+
+def test_section_ends_where_the_next_one_starts():
+    root = parse(SOURCE, outline=True)
+    a, b, c = root.outline.all_sections
+    assert a.end_pos == c.start_pos
+    assert b.end_pos == c.start_pos
+    assert c.end_pos == len(SOURCE)
+
+
+def test_content_follows_edits():
+    root = parse(SOURCE, outline=True)
+    a, b, c = root.outline.all_sections
+    root.children[0].remove()
+    assert a.content.start == 1
+    assert a.content.string == " a text \\subsection{B} b "
+    b.command.remove()
+    assert a.content.string == " a text  b "
+    assert c.content.string == " c"
+    with pytest.raises(RuntimeError):
+        len(b.content)
+
+
+def test_headings_in_arguments_are_ignored():
+    root = parse("\\newcommand{\\h}{\\section{X}}\\section{A}", outline=True)
+    assert [section.title for section in root.outline.all_sections] == ["A"]
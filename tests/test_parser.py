@@ -0,0 +1,22 @@
+from fast_tex_parser import Parser, parse
+
+
+def test_reused_parser_matches_parse():
+    parser = Parser()
+    for source in ["\\section{a}x", "\\begin{b}\\textbf{y}\\end{b}", "% c\nz"]:
+        assert parser.parse(source).repr() == parse(source).repr()
+
+
+def test_buffers_are_trimmed_after_large_documents():
+    parser = Parser(max_retained_bytes=0)
+    source = "\\a{" * 500 + "}" * 500
+    for _ in range(3):
+        assert parser.parse(source).string == source
+    assert parser.parse("x").string == "x"
+
+
+def test_max_retained_bytes_is_writable():
+    parser = Parser()
+    assert parser.max_retained_bytes == 1 << 20
+    parser.max_retained_bytes = 16
+    assert parser.max_retained_bytes == 16
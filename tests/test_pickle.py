@@ -0,0 +1,56 @@
+import pickle
+
+import pytest
+
+from fast_tex_parser import TexCommand, TexRoot, parse
+
+SOURCE = "\\section{A}\\label{a}\n% comment\n\\begin{itemize}\\item x \\ref{a}\\end{itemize}\n\\textbf{b}"
+
+
+def test_round_trip():
+    root = parse(SOURCE)
+    copy = pickle.loads(pickle.dumps(root))
+    assert isinstance(copy, TexRoot)
+    assert copy.repr() == root.repr()
+    assert copy.string == root.string
+    assert copy.structural_hash == root.structural_hash
+
+
+def test_subtree_round_trip():
+    command = parse(SOURCE).find_command("textbf")
+    copy = pickle.loads(pickle.dumps(command))
+    assert isinstance(copy, TexCommand)
+    assert copy.string == "\\textbf{b}"
+    assert copy.parent is None
+
+
+def test_edited_tree_round_trip():
+    root = parse(SOURCE)
+    root.find_command("textbf").name = "emph"
+    assert pickle.loads(pickle.dumps(root)).string == root.string
+
+
+def test_root_data_is_kept():
+    root = parse("\\newcommand{\\x}{y}\\section{A}\\label{a}\\ref{a}{", recover=True, expand_macros=True,
+                 xrefs=True, outline=True)
+    copy = pickle.loads(pickle.dumps(root))
+    assert [d.message for d in copy.diagnostics] == [d.message for d in root.diagnostics]
+    assert list(copy.macros) == list(root.macros)
+    assert list(copy.xrefs.labels) == ["a"]
+    assert copy.xrefs.labels["a"].command.parent is copy
+    assert [section.title for section in copy.outline.sections] == ["A"]
+
+
+def test_macro_default_args_are_kept():
+    root = parse("\\newcommand{\\f}[1][dflt]{<#1>}\\newcommand{\\g}{h}\\f", expand_macros=True)
+    copy = pickle.loads(pickle.dumps(root))
+    assert copy.macros["f"].default_arg == "dflt"
+    assert copy.macros["g"].default_arg is None
+    assert copy.macros["f"].body == "<#1>"
+    assert copy.string == root.string
+
+
+def test_corrupt_data_raises():
+    data = pickle.dumps(parse(SOURCE))
+    with pytest.raises(Exception):
+        pickle.loads(data[:len(data) // 2])
@@ -0,0 +1,37 @@
+from fast_tex_parser import to_plaintext
+
+
+def test_command_arguments_are_dropped_by_default():
+    assert to_plaintext("Hello \\textbf{world}!").text == "Hello !"
+
+
+def test_keep_args_of():
+    assert to_plaintext("Hello \\textbf{world}!", keep_args_of=["textbf"]).text == "Hello world!"
+
+
+def test_keep_args_of_drops_optional_args():
+    assert to_plaintext("\\section[Short]{Long}", keep_args_of=["section"]).text == "Long"
+
+
+def test_comments_and_escapes():
+    assert to_plaintext("a% comment\nb").text == "ab"
+    assert to_plaintext("50\\% off").text == "50% off"
+    assert to_plaintext("a~b").text == "a b"
+
+
+def test_environments():
+    assert to_plaintext("\\begin{itemize}a\\end{itemize}").text == "a"
+    assert to_plaintext("x\\begin{equation}y\\end{equation}z", drop_envs=["equation"]).text == "xz"
+
+
+def test_offsets_map_back_to_the_source():
+    source = "a\\b{c}d"
+    result = to_plaintext(source, offsets=True)
+    assert result.text == "ad"
+    offsets = memoryview(result.offsets).tolist()
+    assert offsets == [0, 6]
+    assert all(source[offset] == char for char, offset in zip(result.text, offsets))
+
+
+def test_offsets_are_optional():
+    assert to_plaintext("a").offsets is None
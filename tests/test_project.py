@@ -0,0 +1,88 @@
+from fast_tex_parser import parse_project
+
+
+def write_project(tmp_path, files):
+    for name, source in files.items():
+        (tmp_path / name).write_text(source)
+    return str(tmp_path / "main.tex")
+
+
+def test_preamble_macros_reach_included_files(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "\\newcommand{\\R}{\\mathbb{R}}\\input{a}",
+        "a.tex": "A \\R",
+    })
+    root = parse_project(main, expand_macros=True)
+    assert root.string == "\\newcommand{\\R}{\\mathbb{R}}A \\mathbb{R}"
+
+
+def test_macros_carry_forward_between_included_files(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "\\input{a}\\input{b}",
+        "a.tex": "\\newcommand{\\x}{X}",
+        "b.tex": "\\x",
+    })
+    root = parse_project(main, expand_macros=True)
+    assert root.string.endswith("}X")
+    assert "x" in root.macros
+
+
+def test_inclusions_made_by_macros_are_followed(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "\\newcommand{\\chap}[1]{\\input{#1}}\\input{a}\\chap{a}\\chap{b}",
+        "a.tex": "A",
+        "b.tex": "B",
+    })
+    root = parse_project(main, expand_macros=True)
+    assert root.string == "\\newcommand{\\chap}[1]{\\input{#1}}AAB"
+    assert root.diagnostics == []
+
+
+def test_inclusions_in_arguments_are_left_in_place(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "\\textbf{\\input{a}}",
+        "a.tex": "A",
+    })
+    root = parse_project(main)
+    assert root.string == "\\textbf{\\input{a}}"
+
+
+def test_label_defined_in_two_files_is_reported(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "\\label{x}\\input{a}",
+        "a.tex": "\\label{x}",
+    })
+    root = parse_project(main, xrefs=True)
+    assert [diagnostic.message for diagnostic in root.diagnostics] == [
+        str(tmp_path / "a.tex") + ": label 'x' defined multiple times"]
+    assert root.xrefs.labels["x"].command.source_file == str(tmp_path / "main.tex")
+
+
+def test_macros_defined_in_included_files_reach_the_rest_of_the_main_file(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "\\input{defs}\\foo",
+        "defs.tex": "\\newcommand{\\foo}{F}",
+    })
+    root = parse_project(main, expand_macros=True)
+    assert root.string == "\\newcommand{\\foo}{F}F"
+
+
+def test_macros_defined_after_an_inclusion_do_not_reach_it(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "\\input{a}\\newcommand{\\x}{X}\\x",
+        "a.tex": "\\x",
+    })
+    root = parse_project(main, expand_macros=True)
+    assert root.string == "\\x\\newcommand{\\x}{X}X"
+
+
+def test_positions_are_relative_to_each_file(tmp_path):
+    main = write_project(tmp_path, {
+        "main.tex": "Intro\n\\input{a}\n\\section{End}",
+        "a.tex": "A\n\\section{Middle}",
+    })
+    root = parse_project(main)
+    middle, end = root.find_commands("section")
+    assert middle.source_file == str(tmp_path / "a.tex")
+    assert (middle.start_pos, middle.start_line) == (2, 1)
+    assert (end.start_pos, end.start_line) == (16, 2)
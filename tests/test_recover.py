@@ -0,0 +1,53 @@
+import pytest
+
+from fast_tex_parser import TexArg, parse
+
+
+def test_bare_group_raises_without_recovery():
+    with pytest.raises(RuntimeError):
+        parse("a {b} c")
+
+
+def test_bare_group_becomes_argument():
+    root = parse("a {b} c", recover=True)
+    assert isinstance(root.children[1], TexArg)
+    assert root.string == "a {b} c"
+    assert len(root.diagnostics) == 1
+
+
+def test_unclosed_items_are_closed_at_the_end():
+    root = parse("\\begin{a}\\textbf{x", recover=True)
+    assert root.string == "\\begin{a}\\textbf{x"
+    messages = [diagnostic.message for diagnostic in root.diagnostics]
+    assert [message.split(" ")[1] for message in messages] == ["argument", "command", "environment"]
+
+
+def test_mismatched_end_raises_without_recovery():
+    with pytest.raises(RuntimeError):
+        parse("\\begin{a}\\begin{b}\\end{a}")
+
+
+def test_mismatched_end_closes_inner_environments():
+    source = "\\begin{a}x\\begin{b}y\\begin{c}z\\end{a} w"
+    root = parse(source, recover=True)
+    assert root.string == source
+    a = root.children[0]
+    assert a.name == "a"
+    b = a.children[1]
+    assert b.name == "b"
+    assert b.children[1].name == "c"
+    assert root.children[1].text == " w"
+    assert [diagnostic.pos for diagnostic in root.diagnostics] == [20, 10]
+    assert "closed implicitly by \\end{a}" in root.diagnostics[0].message
+
+
+def test_mismatched_end_at_end_of_input():
+    root = parse("\\begin{a}\\begin{b}\\end{a}", recover=True)
+    assert root.children[0].children[0].name == "b"
+    assert len(root.diagnostics) == 1
+
+
+def test_unmatched_end_is_kept_as_command():
+    root = parse("\\begin{a}\\end{z}\\end{a}")
+    assert root.children[0].children[0].name == "end"
+    assert root.diagnostics == []
@@ -0,0 +1,26 @@
+from fast_tex_parser import parse
+
+
+def test_full_repr_is_unchanged_by_limits_that_are_not_reached():
+    root = parse("a \\textbf{b \\emph{c}}")
+    assert root.repr() == repr(root)
+    assert root.repr(max_depth=10, max_length=10000) == repr(root)
+
+
+def test_depth_limit_elides_deeper_children():
+    root = parse("a \\textbf{b \\emph{c}}")
+    assert root.repr(max_depth=1) == "TexRoot(\n    t'a ',\n    TexCommand(textbf: ...),\n)"
+
+
+def test_length_limit_never_splits_a_character():
+    root = parse("ééééé\ta")
+    full = repr(root)
+    for max_length in range(1, len(full.encode())):
+        shortened = root.repr(max_length=max_length)
+        assert shortened.endswith("...")
+        assert len(shortened[:-3].encode()) <= max_length
+        assert full.startswith(shortened[:-3])
+
+
+def test_escapes():
+    assert repr(parse("a\tb\nc")) == "TexRoot(\n    t'a\\tb\\nc',\n)"
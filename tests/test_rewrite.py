@@ -0,0 +1,36 @@
+from fast_tex_parser import TexRewriteRules, parse, rewrite
+
+
+def test_rename_commands_and_envs():
+    rules = TexRewriteRules(rename_commands={"emph": "textit"}, rename_envs={"itemize": "enumerate"})
+    assert rewrite("\\emph{a} \\emphx{b}", rules) == "\\textit{a} \\emphx{b}"
+    assert rewrite("\\begin{itemize}x\\end{itemize}", rules) == "\\begin{enumerate}x\\end{enumerate}"
+
+
+def test_delete_commands_and_nested_envs():
+    rules = TexRewriteRules(delete_commands=["todo"], delete_envs=["comment"])
+    assert rewrite("a\\todo[x]{b} c", rules) == "a c"
+    assert rewrite("a\\begin{comment}\\begin{comment}x\\end{comment}\\end{comment}b", rules) == "ab"
+
+
+def test_replace_with_arg_rewrites_the_argument():
+    rules = TexRewriteRules(rename_commands={"emph": "textit"}, replace_with_arg={"textbf": 0, "href": 1})
+    assert rewrite("\\textbf{\\emph{a}} \\href{u}{t}", rules) == "\\textit{a} t"
+
+
+def test_drop_comments_keeps_escaped_percent():
+    assert rewrite("a% c\nb\\%", TexRewriteRules(drop_comments=True)) == "ab\\%"
+
+
+def test_untouched_source_is_copied_verbatim():
+    source = "x  \\foo [a] {b}\n\n% c\n"
+    assert rewrite(source, TexRewriteRules()) == source
+
+
+def test_rewrite_element_and_file(tmp_path):
+    root = parse("\\section{A}\\emph{b}")
+    rules = TexRewriteRules(rename_commands={"emph": "textit"})
+    assert rewrite(root.find_command("emph"), rules) == "\\textit{b}"
+    path = tmp_path / "out.tex"
+    assert rewrite(root, rules, str(path)) is None
+    assert path.read_text() == "\\section{A}\\textit{b}"
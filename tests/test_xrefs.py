@@ -0,0 +1,26 @@
+from fast_tex_parser import parse
+
+
+def test_labels_refs_and_cites_are_indexed():
+    root = parse("\\section{A}\\label{sec:a}\\begin{figure}\\label{fig:x}\\end{figure}"
+                 "see \\ref{fig:x}, \\cref{sec:a, fig:x} and \\citep[p. 2]{knuth, lamport}", xrefs=True)
+    assert sorted(root.xrefs.labels) == ["fig:x", "sec:a"]
+    assert root.xrefs.labels["fig:x"].env.name == "figure"
+    assert root.xrefs.labels["sec:a"].section.name == "section"
+    assert [xref.command.name for xref in root.xrefs.refs["fig:x"]] == ["ref", "cref"]
+    assert len(root.xrefs.refs["sec:a"]) == 1
+    assert sorted(root.xrefs.cites) == ["knuth", "lamport"]
+
+
+def test_single_refs_are_not_split():
+    root = parse("\\ref{a,b}", xrefs=True)
+    assert list(root.xrefs.refs) == ["a,b"]
+
+
+def test_duplicate_label_is_reported():
+    root = parse("\\label{x}\\label{x}", xrefs=True)
+    assert [diagnostic.message for diagnostic in root.diagnostics] == ["label 'x' defined multiple times"]
+
+
+def test_index_is_only_built_on_request():
+    assert parse("\\label{x}").xrefs is None